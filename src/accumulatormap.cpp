@@ -9,6 +9,8 @@
 #include "txdb.h"
 #include "libzerocoin/Denominations.h"
 
+#include <boost/thread.hpp>
+
 using namespace libzerocoin;
 using namespace std;
 
@@ -58,6 +60,51 @@ bool AccumulatorMap::Accumulate(PublicCoin pubCoin, bool fSkipValidation) {
     return true;
 }
 
+//Add a batch of zerocoins to the accumulators of their denominations.
+//Accumulating is a^x1^x2...^xn = a^(x1*x2*...*xn) mod N, so the coins of each denomination are
+//multiplied together and raised in one exponentiation, with the denominations done in parallel.
+bool AccumulatorMap::Accumulate(const vector<PublicCoin>& vPubCoins, bool fSkipValidation) {
+    map<CoinDenomination, vector<const PublicCoin*> > mapCoins;
+    for (const PublicCoin& pubCoin : vPubCoins) {
+        CoinDenomination denom = pubCoin.getDenomination();
+        if (denom == CoinDenomination::ZQ_ERROR)
+            return false;
+        mapCoins[denom].push_back(&pubCoin);
+    }
+
+    boost::mutex csError;
+    string strError;
+    auto accumulateDenom = [&](CoinDenomination denom, const vector<const PublicCoin*>& vCoins) {
+        try {
+            CBigNum bnProduct = 1;
+            for (const PublicCoin* pcoin : vCoins) {
+                if (!fSkipValidation && !pcoin->validate())
+                    throw runtime_error("Coin is not valid");
+                bnProduct *= pcoin->getValue();
+            }
+            mapAccumulators.at(denom)->increment(bnProduct);
+        } catch (const std::exception& e) {
+            boost::unique_lock<boost::mutex> lock(csError);
+            strError = e.what();
+        }
+    };
+
+    if (mapCoins.size() == 1) {
+        accumulateDenom(mapCoins.begin()->first, mapCoins.begin()->second);
+    } else if (mapCoins.size() > 1) {
+        boost::thread_group threads;
+        for (auto& denomCoins : mapCoins)
+            threads.create_thread(boost::bind<void>(accumulateDenom, denomCoins.first, boost::cref(denomCoins.second)));
+        threads.join_all();
+    }
+
+    // same failure as accumulating the coins one by one
+    if (!strError.empty())
+        throw runtime_error(strError);
+
+    return true;
+}
+
 //Get the value of a specific accumulator
 CBigNum AccumulatorMap::GetValue(CoinDenomination denom) {
     if (denom == CoinDenomination::ZQ_ERROR)
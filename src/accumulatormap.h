@@ -7,6 +7,8 @@
 #include "libzerocoin/Accumulator.h"
 #include "libzerocoin/Coin.h"
 
+#include <vector>
+
 //A map with an accumulator for each denomination
 class AccumulatorMap {
   private:
@@ -15,6 +17,7 @@ class AccumulatorMap {
     AccumulatorMap();
     bool Load(uint256 nCheckpoint);
     bool Accumulate(libzerocoin::PublicCoin pubCoin, bool fSkipValidation = false);
+    bool Accumulate(const std::vector<libzerocoin::PublicCoin>& vPubCoins, bool fSkipValidation = false);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     uint256 GetCheckpoint();
     void Reset();
@@ -169,6 +169,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint) {
 
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
     int nTotalMintsFound = 0;
+    std::vector<PublicCoin> vPubcoins;
     CBlockIndex *pindex = chainActive[nHeight - 20];
 
     while (pindex->nHeight < nHeight - 10) {
@@ -184,31 +185,25 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint) {
         }
 
         //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex)) {
-            LogPrint("zero","%s: failed to read block from disk\n", __func__);
-            return false;
-        }
-
         std::list<PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins)) {
-            LogPrint("zero","%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
+        if (!GetBlockPubcoins(pindex, listPubcoins)) {
+            LogPrint("zero","%s: failed to get zerocoin mintlist from block %d\n", __func__, pindex->nHeight);
             return false;
         }
 
         nTotalMintsFound += listPubcoins.size();
         LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
 
-        //add the pubcoins to accumulator
-        for (const PublicCoin pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true)) {
-                LogPrintf("%s: failed to add pubcoin to accumulator at height %n\n", __func__, pindex->nHeight);
-                return false;
-            }
-        }
+        vPubcoins.insert(vPubcoins.end(), listPubcoins.begin(), listPubcoins.end());
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins to accumulator, all denominations at once
+    if (!mapAccumulators.Accumulate(vPubcoins, true)) {
+        LogPrintf("%s: failed to add pubcoins to accumulator at height %d\n", __func__, nHeight);
+        return false;
+    }
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
     if (nTotalMintsFound == 0) {
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
@@ -222,7 +217,17 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint) {
     return true;
 }
 
-bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError) {
+/** Number of blocks added to a witness snapshot for every lock of cs_main */
+static const int WITNESS_SNAPSHOT_BLOCKS_PER_LOCK = 100;
+
+//! Witnesses only include blocks that are at least two checkpoints deep
+static int GetWitnessHeightStop() {
+    int nChainHeight = chainActive.Height();
+    return nChainHeight - (nChainHeight % 10) - 20;
+}
+
+//! Find the height the mint was added at and the accumulator value its witness starts from
+static bool GetWitnessStart(const PublicCoin& coin, int& nHeightMintAdded, int& nAccStartHeight, CBigNum& bnAccValue) {
     uint256 txid;
     if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid)) {
         LogPrint("zero","%s failed to read mint from db\n", __func__);
@@ -236,7 +241,7 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
         return false;
     }
 
-    int nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
+    nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
     uint256 nCheckpointBeforeMint = 0;
     CBlockIndex* pindex = chainActive[nHeightMintAdded];
     int nChanges = 0;
@@ -262,17 +267,130 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     }
 
     //the height to start accumulating coins to add to witness
-    int nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
+    nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
 
     //Get the accumulator that is right before the cluster of blocks containing our mint was added to the accumulator
-    CBigNum bnAccValue = 0;
-    if (GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue)) {
-        if (bnAccValue > 0) {
-            accumulator.setValue(bnAccValue);
-            witness.resetValue(accumulator, coin);
+    bnAccValue = 0;
+    if (!GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue))
+        bnAccValue = 0;
+
+    return true;
+}
+
+//! Values of the mints in a block that have to be added to the witness of coin
+static bool GetWitnessMintValues(const PublicCoin& coin, int nHeightMintAdded, const CBlockIndex* pindex, std::vector<CBigNum>& vValues) {
+    // if this block contains mints of the denomination that is being spent, then add them to the witness
+    if (!pindex->MintedDenomination(coin.getDenomination()))
+        return true;
+
+    //grab mints from this block
+    list<PublicCoin> listPubcoins;
+    if(!GetBlockPubcoins(pindex, listPubcoins)) {
+        LogPrintf("%s: failed to get zerocoin mintlist from block %d\n", __func__, pindex->nHeight);
+        return false;
+    }
+
+    for (const PublicCoin& pubcoin : listPubcoins) {
+        if (pubcoin.getDenomination() != coin.getDenomination())
+            continue;
+
+        if (pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
+            continue;
+
+        vValues.push_back(pubcoin.getValue());
+    }
+
+    return true;
+}
+
+//! A snapshot can be resumed if it was built for the same mint on the active chain and does not go past nHeightStop
+static bool IsWitnessSnapshotUsable(const CAccumulatorWitnessSnapshot& snapshot, int nAccStartHeight, int nHeightStop) {
+    if (snapshot.IsNull() || snapshot.nStartHeight != nAccStartHeight)
+        return false;
+
+    if (snapshot.nHeight < nAccStartHeight || snapshot.nHeight > nHeightStop)
+        return false;
+
+    const CBlockIndex* pindexLast = chainActive[snapshot.nHeight - 1];
+    return pindexLast && pindexLast->GetBlockHash() == snapshot.hashBlock;
+}
+
+bool UpdateAccumulatorWitnessSnapshot(const PublicCoin& coin, CAccumulatorWitnessSnapshot& snapshot) {
+    int nHeightMintAdded = 0;
+    int nAccStartHeight = 0;
+    int nHeightStop = 0;
+    {
+        LOCK(cs_main);
+        CBigNum bnAccValue = 0;
+        if (!GetWitnessStart(coin, nHeightMintAdded, nAccStartHeight, bnAccValue))
+            return false;
+
+        nHeightStop = GetWitnessHeightStop();
+        if (nHeightStop < nAccStartHeight)
+            return true;
+
+        if (!IsWitnessSnapshotUsable(snapshot, nAccStartHeight, nHeightStop)) {
+            snapshot.SetNull();
+            snapshot.nStartHeight = nAccStartHeight;
+            snapshot.nHeight = nAccStartHeight;
+            snapshot.hashBlock = chainActive[nAccStartHeight - 1]->GetBlockHash();
+            snapshot.bnWitness = Accumulator(Params().Zerocoin_Params(), coin.getDenomination(), bnAccValue).getValue();
         }
     }
 
+    Accumulator accumulator(Params().Zerocoin_Params(), coin.getDenomination(), snapshot.bnWitness);
+    AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, coin);
+    while (snapshot.nHeight < nHeightStop) {
+        if (ShutdownRequested())
+            return false;
+
+        // collect the mints under the lock, the exponentiations are done without holding it
+        CAccumulatorWitnessSnapshot next = snapshot;
+        std::vector<CBigNum> vValues;
+        {
+            LOCK(cs_main);
+            if (!IsWitnessSnapshotUsable(snapshot, nAccStartHeight, nHeightStop)) {
+                LogPrint("zero", "%s : chain changed while updating the witness\n", __func__);
+                return false;
+            }
+
+            int nHeightBatchStop = std::min(nHeightStop, snapshot.nHeight + WITNESS_SNAPSHOT_BLOCKS_PER_LOCK);
+            for (CBlockIndex* pindex = chainActive[snapshot.nHeight]; pindex->nHeight < nHeightBatchStop; pindex = chainActive.Next(pindex)) {
+                if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
+                    ++next.nCheckpointsAdded;
+
+                size_t nValuesBefore = vValues.size();
+                if (!GetWitnessMintValues(coin, nHeightMintAdded, pindex, vValues))
+                    return false;
+
+                next.nMintsAdded += vValues.size() - nValuesBefore;
+                next.nHeight = pindex->nHeight + 1;
+                next.hashBlock = pindex->GetBlockHash();
+            }
+        }
+
+        for (const CBigNum& bnValue : vValues)
+            witness.addRawValue(bnValue);
+
+        next.bnWitness = witness.getValue();
+        snapshot = next;
+    }
+
+    return true;
+}
+
+bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, const CAccumulatorWitnessSnapshot* pSnapshot) {
+    int nHeightMintAdded = 0;
+    int nAccStartHeight = 0;
+    CBigNum bnAccValue = 0;
+    if (!GetWitnessStart(coin, nHeightMintAdded, nAccStartHeight, bnAccValue))
+        return false;
+
+    if (bnAccValue > 0) {
+        accumulator.setValue(bnAccValue);
+        witness.resetValue(accumulator, coin);
+    }
+
     //security level: this is an important prevention of tracing the coins via timing. Security level represents how many checkpoints
     //of accumulated coins are added *beyond* the checkpoint that the mint being spent was added too. If each spend added the exact same
     //amounts of checkpoints after the mint was accumulated, then you could know the range of blocks that the mint originated from.
@@ -286,12 +404,22 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     }
 
     //add the pubcoins (zerocoinmints that have been published to the chain) up to the next checksum starting from the block
-    pindex = chainActive[nAccStartHeight];
-    int nChainHeight = chainActive.Height();
-    int nHeightStop = nChainHeight % 10;
-    nHeightStop = nChainHeight - nHeightStop - 20; // at least two checkpoints deep
+    CBlockIndex* pindex = chainActive[nAccStartHeight];
+    int nHeightStop = GetWitnessHeightStop();
     int nCheckpointsAdded = 0;
     nMintsAdded = 0;
+
+    //resume from the precomputed snapshot when the walk below would have passed its height without stopping
+    if (pSnapshot && IsWitnessSnapshotUsable(*pSnapshot, nAccStartHeight, nHeightStop) &&
+        (nSecurityLevel == 100 || pSnapshot->nCheckpointsAdded < nSecurityLevel)) {
+        Accumulator accumulatorSnapshot(Params().Zerocoin_Params(), coin.getDenomination(), pSnapshot->bnWitness);
+        witness.resetValue(accumulatorSnapshot, coin);
+        pindex = chainActive[pSnapshot->nHeight];
+        nCheckpointsAdded = pSnapshot->nCheckpointsAdded;
+        nMintsAdded = pSnapshot->nMintsAdded;
+        LogPrint("zero", "%s : resuming witness at height %d\n", __func__, pSnapshot->nHeight);
+    }
+
     while (pindex->nHeight < nHeightStop + 1) {
         if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
             ++nCheckpointsAdded;
@@ -309,32 +437,14 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
             break;
         }
 
-        // if this block contains mints of the denomination that is being spent, then add them to the witness
-        if (pindex->MintedDenomination(coin.getDenomination())) {
-            //grab mints from this block
-            CBlock block;
-            if(!ReadBlockFromDisk(block, pindex)) {
-                LogPrintf("%s: failed to read block from disk while adding pubcoins to witness\n", __func__);
-                return false;
-            }
-
-            list<PublicCoin> listPubcoins;
-            if(!BlockToPubcoinList(block, listPubcoins)) {
-                LogPrintf("%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
-                return false;
-            }
-
-            //add the mints to the witness
-            for (const PublicCoin pubcoin : listPubcoins) {
-                if (pubcoin.getDenomination() != coin.getDenomination())
-                    continue;
-
-                if (pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
-                    continue;
+        //add the mints to the witness
+        std::vector<CBigNum> vValues;
+        if (!GetWitnessMintValues(coin, nHeightMintAdded, pindex, vValues))
+            return false;
 
-                witness.addRawValue(pubcoin.getValue());
-                ++nMintsAdded;
-            }
+        for (const CBigNum& bnValue : vValues) {
+            witness.addRawValue(bnValue);
+            ++nMintsAdded;
         }
 
         pindex = chainActive[pindex->nHeight + 1];
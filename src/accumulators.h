@@ -9,9 +9,57 @@
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/Coin.h"
 #include "primitives/zerocoin.h"
+#include "serialize.h"
 #include "uint256.h"
 
-bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError);
+/**
+ * Witness of a mint advanced up to some block height. The wallet keeps one per unspent mint
+ * and moves it forward in the background, so a spend only has to add the newest mints.
+ */
+class CAccumulatorWitnessSnapshot {
+  public:
+    //! first block of the checkpoint interval containing the mint, where the witness starts
+    int nStartHeight;
+    //! next block whose mints have to be added
+    int nHeight;
+    //! hash of block nHeight - 1, a snapshot built on a chain that was reorganized away is discarded
+    uint256 hashBlock;
+    CBigNum bnWitness;
+    int nMintsAdded;
+    int nCheckpointsAdded;
+
+    CAccumulatorWitnessSnapshot() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nStartHeight = 0;
+        nHeight = 0;
+        hashBlock = 0;
+        bnWitness = 0;
+        nMintsAdded = 0;
+        nCheckpointsAdded = 0;
+    }
+
+    bool IsNull() const {
+        return nHeight == 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nStartHeight);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(bnWitness);
+        READWRITE(nMintsAdded);
+        READWRITE(nCheckpointsAdded);
+    }
+};
+
+bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, const CAccumulatorWitnessSnapshot* pSnapshot = NULL);
+bool UpdateAccumulatorWitnessSnapshot(const libzerocoin::PublicCoin& coin, CAccumulatorWitnessSnapshot& snapshot);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
@@ -0,0 +1,135 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The IDChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <univalue.h>
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace benchmark {
+
+bool State::KeepRunning() {
+    int64_t nNow = GetTimeMicros();
+    if (nCount > 0)
+        vSamples.push_back(nNow - nLastTime);
+
+    if (nCount >= nIterations)
+        return false;
+
+    ++nCount;
+    // Take the time again so that the bookkeeping above is not part of the next sample
+    nLastTime = GetTimeMicros();
+    return true;
+}
+
+/** Nearest-rank percentile of an already sorted, non-empty sample vector */
+static int64_t Percentile(const std::vector<int64_t>& vSorted, int nPercent) {
+    size_t nRank = (vSorted.size() * nPercent + 99) / 100;
+    return vSorted[std::max<size_t>(nRank, 1) - 1];
+}
+
+/** Samples needed before the 99th percentile is anything but the maximum */
+static const size_t MIN_SAMPLES_P99 = 100;
+
+Result::Result(const State& state) : name(state.GetName()), nIterations(state.GetSamples().size()),
+    dMean(0), nMin(0), nMedian(0), nP90(0), nP99(0), nMax(0) {
+    std::vector<int64_t> vSorted = state.GetSamples();
+    if (vSorted.empty())
+        return;
+
+    std::sort(vSorted.begin(), vSorted.end());
+    dMean = std::accumulate(vSorted.begin(), vSorted.end(), (int64_t)0) / (double)vSorted.size();
+    nMin = vSorted.front();
+    nMedian = Percentile(vSorted, 50);
+    nP90 = Percentile(vSorted, 90);
+    nP99 = vSorted.size() >= MIN_SAMPLES_P99 ? Percentile(vSorted, 99) : -1;
+    nMax = vSorted.back();
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::benchmarks() {
+    static std::map<std::string, BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+BenchRunner::BenchRunner(const std::string& name, BenchFunction func) {
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+/** A percentile for printing, strMissing when there were too few samples to compute it */
+static std::string FormatPercentile(int64_t nValue, const std::string& strMissing) {
+    return nValue < 0 ? strMissing : strprintf("%d", nValue);
+}
+
+static void PrintConsole(const std::vector<Result>& vResults) {
+    std::cout << strprintf("%-40s %10s %12s %12s %12s %12s %12s %12s\n", "#Benchmark", "count", "mean(us)", "min(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for (const Result& result : vResults) {
+        std::cout << strprintf("%-40s %10d %12.1f %12d %12d %12d %12s %12d\n", result.name, result.nIterations,
+            result.dMean, result.nMin, result.nMedian, result.nP90, FormatPercentile(result.nP99, "-"), result.nMax);
+    }
+}
+
+static void PrintCSV(const std::vector<Result>& vResults) {
+    std::cout << "name,count,mean_us,min_us,p50_us,p90_us,p99_us,max_us\n";
+    for (const Result& result : vResults) {
+        std::cout << strprintf("%s,%d,%.1f,%d,%d,%d,%s,%d\n", result.name, result.nIterations,
+            result.dMean, result.nMin, result.nMedian, result.nP90, FormatPercentile(result.nP99, ""), result.nMax);
+    }
+}
+
+static void PrintJSON(const std::vector<Result>& vResults) {
+    UniValue arr(UniValue::VARR);
+    for (const Result& result : vResults) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", result.name));
+        obj.push_back(Pair("count", result.nIterations));
+        obj.push_back(Pair("mean_us", result.dMean));
+        obj.push_back(Pair("min_us", result.nMin));
+        obj.push_back(Pair("p50_us", result.nMedian));
+        obj.push_back(Pair("p90_us", result.nP90));
+        if (result.nP99 < 0)
+            obj.push_back(Pair("p99_us", NullUniValue));
+        else
+            obj.push_back(Pair("p99_us", result.nP99));
+        obj.push_back(Pair("max_us", result.nMax));
+        arr.push_back(obj);
+    }
+    std::cout << arr.write(2) << "\n";
+}
+
+bool BenchRunner::RunAll(const std::string& strFilter, int64_t nIterations, const std::string& strPrinter) {
+    if (strPrinter != "console" && strPrinter != "csv" && strPrinter != "json")
+        return false;
+
+    std::vector<Result> vResults;
+    for (BenchmarkMap::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+
+        State state(it->first, nIterations);
+        it->second(state);
+        vResults.push_back(Result(state));
+        // Keep the user informed while the (slow) benchmarks run, without polluting machine-readable output
+        if (strPrinter == "console")
+            std::cerr << "." << std::flush;
+    }
+    if (strPrinter == "console")
+        std::cerr << "\n";
+
+    if (strPrinter == "csv")
+        PrintCSV(vResults);
+    else if (strPrinter == "json")
+        PrintJSON(vResults);
+    else
+        PrintConsole(vResults);
+
+    return true;
+}
+}
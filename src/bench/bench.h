@@ -0,0 +1,101 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The IDChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ */
+
+namespace benchmark {
+
+/**
+ * Per-benchmark state. Every iteration is timed separately so the runner can
+ * report percentiles, which matters for the expensive, high-variance zerocoin
+ * operations this harness was written for.
+ */
+class State {
+    std::string name;
+    int64_t nIterations;
+    int64_t nCount;
+    int64_t nLastTime;
+    //! Duration of every iteration, in microseconds
+    std::vector<int64_t> vSamples;
+
+  public:
+    State(const std::string& nameIn, int64_t nIterationsIn) : name(nameIn), nIterations(nIterationsIn), nCount(0), nLastTime(0) {}
+
+    /** Returns true while more iterations should be run, timing the one that just finished */
+    bool KeepRunning();
+
+    const std::string& GetName() const { return name; }
+    const std::vector<int64_t>& GetSamples() const { return vSamples; }
+};
+
+/** Timing summary of one benchmark, all values in microseconds */
+struct Result {
+    std::string name;
+    int64_t nIterations;
+    double dMean;
+    int64_t nMin;
+    int64_t nMedian;
+    int64_t nP90;
+    //! -1 with fewer than 100 samples, where the nearest rank would just be the maximum
+    int64_t nP99;
+    int64_t nMax;
+
+    explicit Result(const State& state);
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner {
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+  public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    /**
+     * Run every benchmark whose name contains strFilter, each for nIterations iterations,
+     * and print the results as "console", "csv" or "json".
+     */
+    static bool RunAll(const std::string& strFilter, int64_t nIterations, const std::string& strPrinter);
+};
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
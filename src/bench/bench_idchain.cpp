@@ -0,0 +1,73 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The IDChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "libzerocoin/SerialNumberSignatureOfKnowledge.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <stdio.h>
+
+#include <boost/thread.hpp>
+
+/** Default number of timed iterations per benchmark */
+static const int64_t DEFAULT_BENCH_ITERATIONS = 10;
+
+CClientUIInterface uiInterface;
+
+int main(int argc, char** argv) {
+    SetupEnvironment();
+    ParseParameters(argc, argv);
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        std::string strUsage = "Usage:\n  bench_idchain [options]\n\n";
+        strUsage += HelpMessageGroup("Options:");
+        strUsage += HelpMessageOpt("-?", "This help message");
+        strUsage += HelpMessageOpt("-filter=<str>", "Only run benchmarks whose name contains <str>, e.g. -filter=/1000 for the 1000 denomination");
+        strUsage += HelpMessageOpt("-par=<n>", "Number of threads serial number proof verification uses (default: all cores)");
+        strUsage += HelpMessageOpt("-iterations=<n>", strprintf("Number of timed iterations per benchmark, p99 is only reported from 100 on (default: %d)", DEFAULT_BENCH_ITERATIONS));
+        strUsage += HelpMessageOpt("-printer=<format>", "Output format: console, csv or json (default: console)");
+        strUsage += HelpMessageOpt("-testnet", "Use the testnet zerocoin parameters");
+        fprintf(stdout, "%s", strUsage.c_str());
+        return EXIT_SUCCESS;
+    }
+
+    // Check for -testnet or -regtest parameter (Params() calls are only valid after this clause)
+    if (!SelectParamsFromCommandLine()) {
+        fprintf(stderr, "Error: Invalid combination of -regtest and -testnet.\n");
+        return EXIT_FAILURE;
+    }
+
+    int64_t nIterations = GetArg("-iterations", DEFAULT_BENCH_ITERATIONS);
+    if (nIterations < 1) {
+        fprintf(stderr, "Error: -iterations must be at least 1.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Same helper threads as the node starts for -par
+    int nThreads = GetArg("-par", 0);
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    boost::thread_group threadGroup;
+    libzerocoin::StartSoKVerifyThreads(threadGroup, nThreads - 1);
+
+    int nRet = EXIT_SUCCESS;
+    try {
+        if (!benchmark::BenchRunner::RunAll(GetArg("-filter", ""), nIterations, GetArg("-printer", "console"))) {
+            fprintf(stderr, "Error: Unknown -printer format, use console, csv or json.\n");
+            nRet = EXIT_FAILURE;
+        }
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "bench_idchain");
+        nRet = EXIT_FAILURE;
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    return nRet;
+}
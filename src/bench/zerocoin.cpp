@@ -0,0 +1,128 @@
+// Copyright (c) 2019 The IDChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "libzerocoin/Accumulator.h"
+#include "libzerocoin/AccumulatorProofOfKnowledge.h"
+#include "libzerocoin/Coin.h"
+#include "libzerocoin/CoinSpend.h"
+#include "libzerocoin/Commitment.h"
+#include "libzerocoin/Denominations.h"
+#include "tinyformat.h"
+
+#include <map>
+#include <memory>
+
+using namespace libzerocoin;
+
+/** Number of coins minted per denomination to feed the accumulator and witness benchmarks */
+static const unsigned int BENCH_COINS_PER_DENOM = 5;
+
+/**
+ * Coins, accumulator and witness shared by all benchmarks of one denomination.
+ * Minting is slow, so this is built once on first use and excluded from the timings.
+ */
+struct DenominationFixture {
+    std::vector<PrivateCoin> vCoins;
+    std::unique_ptr<Accumulator> accumulator;
+    std::unique_ptr<AccumulatorWitness> witness;
+
+    explicit DenominationFixture(CoinDenomination denom) {
+        ZerocoinParams* params = Params().Zerocoin_Params();
+        for (unsigned int i = 0; i < BENCH_COINS_PER_DENOM; i++)
+            vCoins.push_back(PrivateCoin(params, denom));
+
+        // witness for the first coin, everything accumulated after it
+        accumulator.reset(new Accumulator(params, denom));
+        witness.reset(new AccumulatorWitness(params, *accumulator, vCoins[0].getPublicCoin()));
+        for (const PrivateCoin& coin : vCoins) {
+            *accumulator += coin.getPublicCoin();
+            *witness += coin.getPublicCoin();
+        }
+    }
+};
+
+static DenominationFixture& GetFixture(CoinDenomination denom) {
+    static std::map<CoinDenomination, std::unique_ptr<DenominationFixture> > mapFixtures;
+    std::unique_ptr<DenominationFixture>& pfixture = mapFixtures[denom];
+    if (!pfixture)
+        pfixture.reset(new DenominationFixture(denom));
+    return *pfixture;
+}
+
+static void ZerocoinMint(benchmark::State& state, CoinDenomination denom) {
+    ZerocoinParams* params = Params().Zerocoin_Params();
+    while (state.KeepRunning()) {
+        PrivateCoin coin(params, denom);
+    }
+}
+
+static void ZerocoinAccumulate(benchmark::State& state, CoinDenomination denom) {
+    DenominationFixture& fixture = GetFixture(denom);
+    Accumulator accumulator(Params().Zerocoin_Params(), denom);
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        accumulator.accumulate(fixture.vCoins[i++ % fixture.vCoins.size()].getPublicCoin());
+    }
+}
+
+// The update GenerateAccumulatorWitness() performs for every mint added after the checkpoint
+static void ZerocoinWitnessUpdate(benchmark::State& state, CoinDenomination denom) {
+    DenominationFixture& fixture = GetFixture(denom);
+    AccumulatorWitness witness(*fixture.witness);
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        witness.addRawValue(fixture.vCoins[i++ % fixture.vCoins.size()].getPublicCoin().getValue());
+    }
+}
+
+static void ZerocoinSpendCreate(benchmark::State& state, CoinDenomination denom) {
+    DenominationFixture& fixture = GetFixture(denom);
+    ZerocoinParams* params = Params().Zerocoin_Params();
+    while (state.KeepRunning()) {
+        CoinSpend spend(params, fixture.vCoins[0], *fixture.accumulator, 0, *fixture.witness, 0);
+    }
+}
+
+static void ZerocoinSpendVerify(benchmark::State& state, CoinDenomination denom) {
+    DenominationFixture& fixture = GetFixture(denom);
+    CoinSpend spend(Params().Zerocoin_Params(), fixture.vCoins[0], *fixture.accumulator, 0, *fixture.witness, 0);
+    while (state.KeepRunning()) {
+        if (!spend.Verify(*fixture.accumulator))
+            throw std::runtime_error("ZerocoinSpendVerify: spend did not verify");
+    }
+}
+
+static void AccumulatorPoKVerify(benchmark::State& state, CoinDenomination denom) {
+    DenominationFixture& fixture = GetFixture(denom);
+    const AccumulatorAndProofParams* accParams = &Params().Zerocoin_Params()->accumulatorParams;
+    const Commitment commitment(&accParams->accumulatorPoKCommitmentGroup, fixture.vCoins[0].getPublicCoin().getValue());
+    AccumulatorProofOfKnowledge proof(accParams, commitment, *fixture.witness, *fixture.accumulator);
+    while (state.KeepRunning()) {
+        if (!proof.Verify(*fixture.accumulator, commitment.getCommitmentValue()))
+            throw std::runtime_error("AccumulatorPoKVerify: proof did not verify");
+    }
+}
+
+/** Registers one benchmark per zerocoin denomination, named <name>/<denomination> */
+struct DenominationBenchRunner {
+    DenominationBenchRunner(const std::string& strName, void (*func)(benchmark::State&, CoinDenomination)) {
+        for (CoinDenomination denom : zerocoinDenomList) {
+            benchmark::BenchRunner(strprintf("%s/%d", strName, ZerocoinDenominationToInt(denom)),
+                [func, denom](benchmark::State& state) { func(state, denom); });
+        }
+    }
+};
+
+#define BENCHMARK_DENOMINATIONS(n) \
+    static DenominationBenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+BENCHMARK_DENOMINATIONS(ZerocoinMint);
+BENCHMARK_DENOMINATIONS(ZerocoinAccumulate);
+BENCHMARK_DENOMINATIONS(ZerocoinWitnessUpdate);
+BENCHMARK_DENOMINATIONS(ZerocoinSpendCreate);
+BENCHMARK_DENOMINATIONS(ZerocoinSpendVerify);
+BENCHMARK_DENOMINATIONS(AccumulatorPoKVerify);
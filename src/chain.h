@@ -14,6 +14,7 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <stdexcept>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -95,6 +96,82 @@ enum BlockStatus {
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 };
 
+/**
+ * Number of coins in circulation per zerocoin denomination. Every block index entry carries one,
+ * so this is a flat array rather than a std::map, but it serializes exactly like the
+ * std::map<CoinDenomination, int64_t> it replaced to keep the block index database compatible.
+ */
+class CZerocoinSupply {
+  private:
+    static const unsigned int DENOMINATIONS = 7;
+    int64_t anSupply[DENOMINATIONS];
+
+    //! position of denom in zerocoinDenomList, -1 for an unknown denomination
+    static int GetIndex(libzerocoin::CoinDenomination denom) {
+        switch (denom) {
+        case libzerocoin::ZQ_ONE: return 0;
+        case libzerocoin::ZQ_FIVE: return 1;
+        case libzerocoin::ZQ_TEN: return 2;
+        case libzerocoin::ZQ_FIFTY: return 3;
+        case libzerocoin::ZQ_ONE_HUNDRED: return 4;
+        case libzerocoin::ZQ_FIVE_HUNDRED: return 5;
+        case libzerocoin::ZQ_ONE_THOUSAND: return 6;
+        default: return -1;
+        }
+    }
+
+  public:
+    CZerocoinSupply() {
+        SetNull();
+    }
+
+    void SetNull() {
+        for (unsigned int i = 0; i < DENOMINATIONS; i++)
+            anSupply[i] = 0;
+    }
+
+    //! like std::map::at(), throws std::out_of_range for an unknown denomination
+    int64_t& at(libzerocoin::CoinDenomination denom) {
+        int nIndex = GetIndex(denom);
+        if (nIndex < 0)
+            throw std::out_of_range("CZerocoinSupply::at() : unknown denomination");
+        return anSupply[nIndex];
+    }
+
+    int64_t at(libzerocoin::CoinDenomination denom) const {
+        return const_cast<CZerocoinSupply*>(this)->at(denom);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return GetSizeOfCompactSize(DENOMINATIONS) + DENOMINATIONS * (sizeof(libzerocoin::CoinDenomination) + sizeof(int64_t));
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        // zerocoinDenomList is in ascending order, the key order of the std::map
+        WriteCompactSize(s, DENOMINATIONS);
+        for (libzerocoin::CoinDenomination denom : libzerocoin::zerocoinDenomList) {
+            ::Serialize(s, denom, nType, nVersion);
+            ::Serialize(s, at(denom), nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        SetNull();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            ::Unserialize(s, denom, nType, nVersion);
+            ::Unserialize(s, nSupply, nType, nVersion);
+            int nIndex = GetIndex(denom);
+            if (nIndex >= 0)
+                anSupply[nIndex] = nSupply;
+        }
+    }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -173,7 +250,7 @@ class CBlockIndex {
     uint32_t nSequenceId;
 
     //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+    CZerocoinSupply mapZerocoinSupply;
     std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
 
     void SetNull() {
@@ -205,9 +282,7 @@ class CBlockIndex {
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(make_pair(denom, 0));
-        }
+        mapZerocoinSupply.SetNull();
         vMintDenominationsInBlock.clear();
     }
 
@@ -91,7 +91,8 @@ typedef u_int SOCKET;
 size_t strnlen_int(const char* start, size_t max_len);
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(HAVE_SYS_EPOLL_H)
+    // Windows fd_sets hold socket handles, epoll and poll() have no FD_SETSIZE limit
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -7,6 +7,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/assign/list_of.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
 
 #include "db.h"
 #include "kernel.h"
@@ -230,34 +233,105 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+/**
+ * Heights and times of the active chain blocks that generated a stake modifier, in chain order.
+ * Lets GetKernelStakeModifier find the modifier a selection interval after a block with a binary
+ * search instead of walking chainActive one block at a time for every kernel it checks.
+ */
+class CStakeModifierIndex {
+    struct Entry {
+        int nHeight;
+        int64_t nTime;
+        //! Largest nTime of this and all earlier entries, block times are not monotonic
+        int64_t nMaxTime;
+    };
+
+    std::vector<Entry> vEntries;
+    //! Tip of the chain vEntries was built from
+    const CBlockIndex* pindexTip;
+    boost::mutex cs;
+
+    void SyncLocked(const CChain& chain) {
+        if (pindexTip == chain.Tip())
+            return;
+
+        // Drop the entries of disconnected blocks, then append those of the newly connected ones
+        const CBlockIndex* pindexFork = (pindexTip && chain.Tip()) ? chain.FindFork(pindexTip) : NULL;
+        const int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+        while (!vEntries.empty() && vEntries.back().nHeight > nForkHeight)
+            vEntries.pop_back();
+
+        for (int nHeight = nForkHeight + 1; nHeight <= chain.Height(); nHeight++) {
+            const CBlockIndex* pindex = chain[nHeight];
+            if (!pindex->GeneratedStakeModifier())
+                continue;
+            Entry entry = {nHeight, pindex->GetBlockTime(), pindex->GetBlockTime()};
+            if (!vEntries.empty())
+                entry.nMaxTime = std::max(entry.nMaxTime, vEntries.back().nMaxTime);
+            vEntries.push_back(entry);
+        }
+        pindexTip = chain.Tip();
+    }
+
+  public:
+    CStakeModifierIndex() : pindexTip(NULL) {}
+
+    void Sync(const CChain& chain) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        SyncLocked(chain);
+    }
+
+    /** Find the first modifier generated above nHeightFrom at or after nTimeMin */
+    bool Find(const CChain& chain, int nHeightFrom, int64_t nTimeMin, int& nHeightRet, int64_t& nTimeRet) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        SyncLocked(chain);
+
+        std::vector<Entry>::const_iterator it = std::upper_bound(vEntries.begin(), vEntries.end(), nHeightFrom,
+            [](int nHeight, const Entry& entry) { return nHeight < entry.nHeight; });
+        std::vector<Entry>::const_iterator itTime = std::lower_bound(vEntries.begin(), vEntries.end(), nTimeMin,
+            [](const Entry& entry, int64_t nTime) { return entry.nMaxTime < nTime; });
+        // Nothing before itTime is late enough; from there on only out of order timestamps need a step forward
+        it = std::max(it, itTime);
+        while (it != vEntries.end() && it->nTime < nTimeMin)
+            ++it;
+        if (it == vEntries.end())
+            return false;
+
+        nHeightRet = it->nHeight;
+        nTimeRet = it->nTime;
+        return true;
+    }
+};
+
+static CStakeModifierIndex stakeModifierIndex;
+
+void UpdateStakeModifierIndex() {
+    stakeModifierIndex.Sync(chainActive);
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake) {
-    nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
+bool GetKernelStakeModifier(uint256 hashBlockFrom, CKernelStakeModifier& modifier) {
+    modifier.nModifier = 0;
+    BlockMap::const_iterator mi = mapBlockIndex.find(hashBlockFrom);
+    if (mi == mapBlockIndex.end())
         return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
-    nStakeModifierHeight = pindexFrom->nHeight;
-    nStakeModifierTime = pindexFrom->GetBlockTime();
+    const CBlockIndex* pindexFrom = mi->second;
+    modifier.nHeightBlockFrom = pindexFrom->nHeight;
+    modifier.nHeight = pindexFrom->nHeight;
+    modifier.nTime = pindexFrom->GetBlockTime();
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
-    const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
-
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindexNext) {
-            // Should never happen
-            return error("Null pindexNext\n");
-        }
 
-        pindex = pindexNext;
-        pindexNext = chainActive[pindexNext->nHeight + 1];
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
-        }
+    // find the stake modifier later by a selection interval
+    if (!stakeModifierIndex.Find(chainActive, pindexFrom->nHeight, pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval,
+            modifier.nHeight, modifier.nTime)) {
+        // Should never happen
+        return error("Null pindexNext\n");
     }
-    nStakeModifier = pindex->nStakeModifier;
+    const CBlockIndex* pindex = chainActive[modifier.nHeight];
+    if (!pindex)
+        return error("GetKernelStakeModifier() : modifier block not in active chain");
+    modifier.nModifier = pindex->nStakeModifier;
     return true;
 }
 
@@ -267,6 +341,18 @@ uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutInde
     return Hash(ss.begin(), ss.end());
 }
 
+CStakeKernelHasher::CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int prevoutIndex, const uint256& prevoutHash) :
+    ssPrefix(SER_GETHASH, 0) {
+    // same layout as stakeHash()
+    ssPrefix << nStakeModifier << nTimeBlockFrom << prevoutIndex << prevoutHash;
+}
+
+uint256 CStakeKernelHasher::GetHash(unsigned int nTimeTx) const {
+    CHashWriter ss(ssPrefix);
+    ss << nTimeTx;
+    return ss.GetHash();
+}
+
 //test hash vs target
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay) {
     //get the stake weight - weight is equal to coin amount
@@ -277,10 +363,22 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 }
 
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake) {
+bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake) {
+    //grab stake modifier
+    CKernelStakeModifier modifier;
+    if (!GetKernelStakeModifier(blockFrom.GetHash(), modifier)) {
+        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
+        return false;
+    }
+
+    return CheckStakeKernelHash(nBits, blockFrom, modifier, txPrev, prevout, nTimeTx, nHashDrift, fCheck, hashProofOfStake, fPrintProofOfStake);
+}
+
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockHeader& blockFrom, const CKernelStakeModifier& modifier, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake) {
     //assign new variables to make it easier to read
     int64_t nValueIn = txPrev.vout[prevout.n].nValue;
     unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    const uint64_t nStakeModifier = modifier.nModifier;
 
     if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
@@ -297,25 +395,18 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     uint256 bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
 
-    //grab stake modifier
-    uint64_t nStakeModifier = 0;
-    int nStakeModifierHeight = 0;
-    int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
-        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
-        return false;
-    }
-
-    //create data stream once instead of repeating it in the loop
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier;
+    //serialize everything but the time once instead of repeating it in the loop
+    const CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevout.n, prevout.hash);
 
     //if wallet is simply checking to make sure a hash is valid
     if (fCheck) {
-        hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+        hashProofOfStake = hasher.GetHash(nTimeTx);
         return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
     }
 
+    //the target only depends on the coin, same as stakeTargetHit()
+    const uint256 bnTarget = (uint256(nValueIn) / 100) * bnTargetPerCoinDay;
+
     bool fSuccess = false;
     unsigned int nTryTime = 0;
     unsigned int i;
@@ -327,10 +418,10 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
 
         //hash this iteration
         nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+        hashProofOfStake = hasher.GetHash(nTryTime);
 
         // if stake hash does not meet the target then continue to next iteration
-        if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
+        if (!(hashProofOfStake < bnTarget))
             continue;
 
         fSuccess = true; // if we make it this far then we have successfully created a stake hash
@@ -338,9 +429,9 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
 
         if (fDebug || fPrintProofOfStake) {
             LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
-                      std::to_string(nStakeModifier).c_str(), nStakeModifierHeight,
-                      DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                      mapBlockIndex[blockFrom.GetHash()]->nHeight,
+                      std::to_string(nStakeModifier).c_str(), modifier.nHeight,
+                      DateTimeStrFormat("%Y-%m-%d %H:%M:%S", modifier.nTime).c_str(),
+                      modifier.nHeightBlockFrom,
                       DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
             LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
                       "0.3",
@@ -351,8 +442,6 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
         break;
     }
 
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
     return fSuccess;
 }
 
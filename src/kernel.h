@@ -7,6 +7,7 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "hash.h"
 #include "main.h"
 
 
@@ -23,11 +24,43 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Bring the stake modifier index used by GetKernelStakeModifier in line with chainActive
+void UpdateStakeModifierIndex();
+
+// Computes stakeHash() of one kernel for many transaction times.
+// Everything but the time is serialized once, each time slot only hashes its own
+// 4 bytes on a copy of that state, without copying the stream or allocating.
+class CStakeKernelHasher {
+  private:
+    CHashWriter ssPrefix;
+
+  public:
+    CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int prevoutIndex, const uint256& prevoutHash);
+    uint256 GetHash(unsigned int nTimeTx) const;
+};
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+// Stake modifier used for a kernel, and where it was taken from
+struct CKernelStakeModifier {
+    uint64_t nModifier;
+    int nHeight;
+    int64_t nTime;
+    //! height of the block the staked output is from
+    int nHeightBlockFrom;
+
+    CKernelStakeModifier() : nModifier(0), nHeight(0), nTime(0), nHeightBlockFrom(0) {}
+};
+
+// Look up the stake modifier for a kernel from block hashBlockFrom, requires cs_main
+bool GetKernelStakeModifier(uint256 hashBlockFrom, CKernelStakeModifier& modifier);
+// Same as above with the stake modifier looked up beforehand, so it does not touch the block index
+// and can run without cs_main (e.g. on the stake search threads)
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockHeader& blockFrom, const CKernelStakeModifier& modifier, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
@@ -0,0 +1,101 @@
+/**
+ * @file       FixedBaseExp.cpp
+ *
+ * @brief      Montgomery and fixed-base modular exponentiation helpers for the Zerocoin library.
+ **/
+// Copyright (c) 2019 The IDChain Core Developers
+
+#include "FixedBaseExp.h"
+
+namespace libzerocoin {
+
+MontgomeryContext::MontgomeryContext(const CBigNum& modulusIn) : modulus(modulusIn), pmont(NULL) {
+    // Montgomery reduction only works for odd moduli
+    if (!BN_is_odd(&modulus))
+        return;
+
+    CAutoBN_CTX pctx;
+    pmont = BN_MONT_CTX_new();
+    if (pmont == NULL)
+        throw bignum_error("MontgomeryContext : BN_MONT_CTX_new() returned NULL");
+    if (!BN_MONT_CTX_set(pmont, &modulus, pctx)) {
+        BN_MONT_CTX_free(pmont);
+        throw bignum_error("MontgomeryContext : BN_MONT_CTX_set failed");
+    }
+}
+
+MontgomeryContext::~MontgomeryContext() {
+    if (pmont != NULL)
+        BN_MONT_CTX_free(pmont);
+}
+
+CBigNum MontgomeryContext::pow_mod(const CBigNum& base, const CBigNum& e) const {
+    if (pmont == NULL || e < 0)
+        return base.pow_mod(e, modulus);
+
+    CAutoBN_CTX pctx;
+    CBigNum ret;
+    if (!BN_mod_exp_mont(&ret, &base, &e, &modulus, pctx, pmont))
+        throw bignum_error("MontgomeryContext::pow_mod : BN_mod_exp_mont failed");
+
+    return ret;
+}
+
+FixedBaseExp::FixedBaseExp(const CBigNum& baseIn, const MontgomeryContext& montIn, unsigned int nMaxExpBitsIn) :
+    base(baseIn), mont(montIn), nMaxExpBits(nMaxExpBitsIn) {
+    if (mont.get() == NULL)
+        return;
+
+    const unsigned int nWindows = (nMaxExpBits + WINDOW_BITS - 1) / WINDOW_BITS;
+    table.resize(nWindows * WINDOW_SIZE);
+
+    CAutoBN_CTX pctx;
+    // power = base^(2^(WINDOW_BITS * i)), starting with i = 0
+    CBigNum power = base % mont.getModulus();
+    if (!BN_to_montgomery(&power, &power, mont.get(), pctx))
+        throw bignum_error("FixedBaseExp : BN_to_montgomery failed");
+
+    for (unsigned int i = 0; i < nWindows; i++) {
+        const unsigned int nFirst = i * WINDOW_SIZE;
+        table[nFirst] = power;
+        for (unsigned int j = 1; j < WINDOW_SIZE; j++) {
+            if (!BN_mod_mul_montgomery(&table[nFirst + j], &table[nFirst + j - 1], &power, mont.get(), pctx))
+                throw bignum_error("FixedBaseExp : BN_mod_mul_montgomery failed");
+        }
+        // base^(16 * 2^(4i)) = base^(15 * 2^(4i)) * base^(2^(4i))
+        if (!BN_mod_mul_montgomery(&power, &table[nFirst + WINDOW_SIZE - 1], &power, mont.get(), pctx))
+            throw bignum_error("FixedBaseExp : BN_mod_mul_montgomery failed");
+    }
+}
+
+CBigNum FixedBaseExp::pow_mod(const CBigNum& e) const {
+    // Negative and oversized exponents are not covered by the table
+    if (table.empty() || e < 0 || (unsigned int)BN_num_bits(&e) > nMaxExpBits)
+        return base.pow_mod(e, mont.getModulus());
+
+    CAutoBN_CTX pctx;
+    CBigNum acc = 1;
+    if (!BN_to_montgomery(&acc, &acc, mont.get(), pctx))
+        throw bignum_error("FixedBaseExp::pow_mod : BN_to_montgomery failed");
+
+    const int nBits = BN_num_bits(&e);
+    for (int i = 0; i * (int)WINDOW_BITS < nBits; i++) {
+        unsigned int nWindow = 0;
+        for (unsigned int bit = 0; bit < WINDOW_BITS; bit++) {
+            if (BN_is_bit_set(&e, i * WINDOW_BITS + bit))
+                nWindow |= 1 << bit;
+        }
+        if (nWindow == 0)
+            continue;
+        if (!BN_mod_mul_montgomery(&acc, &acc, &table[i * WINDOW_SIZE + nWindow - 1], mont.get(), pctx))
+            throw bignum_error("FixedBaseExp::pow_mod : BN_mod_mul_montgomery failed");
+    }
+
+    CBigNum ret;
+    if (!BN_from_montgomery(&ret, &acc, mont.get(), pctx))
+        throw bignum_error("FixedBaseExp::pow_mod : BN_from_montgomery failed");
+
+    return ret;
+}
+
+} /* namespace libzerocoin */
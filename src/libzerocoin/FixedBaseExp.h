@@ -0,0 +1,86 @@
+/**
+ * @file       FixedBaseExp.h
+ *
+ * @brief      Montgomery and fixed-base modular exponentiation helpers for the Zerocoin library.
+ **/
+// Copyright (c) 2019 The IDChain Core Developers
+
+#ifndef FIXEDBASEEXP_H_
+#define FIXEDBASEEXP_H_
+
+#include <vector>
+#include <openssl/bn.h>
+#include "bignum.h"
+
+namespace libzerocoin {
+
+/**
+ * Montgomery context for a fixed modulus.
+ * The context is set up once and is only read afterwards, so a single
+ * instance can be shared by several threads.
+ */
+class MontgomeryContext {
+  public:
+    explicit MontgomeryContext(const CBigNum& modulus);
+    ~MontgomeryContext();
+
+    /**
+     * modular exponentiation: base^e mod modulus, reusing the precomputed context.
+     * Gives the same result as base.pow_mod(e, modulus).
+     */
+    CBigNum pow_mod(const CBigNum& base, const CBigNum& e) const;
+
+    const CBigNum& getModulus() const {
+        return modulus;
+    }
+
+    //! NULL when the modulus is even and Montgomery arithmetic can not be used
+    BN_MONT_CTX* get() const {
+        return pmont;
+    }
+
+  private:
+    CBigNum modulus;
+    BN_MONT_CTX* pmont;
+
+    MontgomeryContext(const MontgomeryContext&);
+    MontgomeryContext& operator=(const MontgomeryContext&);
+};
+
+/**
+ * Fixed-base windowed exponentiation.
+ * For a base that never changes (a group generator) the powers
+ * base^(j * 2^(w*i)) are computed once, so every later exponentiation
+ * only costs one Montgomery multiplication per non-zero window of the exponent
+ * instead of a full square-and-multiply chain.
+ */
+class FixedBaseExp {
+  public:
+    /**
+     * @param base the fixed base
+     * @param mont Montgomery context of the modulus, must outlive this object
+     * @param nMaxExpBits largest exponent size served from the table, bigger exponents fall back to pow_mod
+     */
+    FixedBaseExp(const CBigNum& base, const MontgomeryContext& mont, unsigned int nMaxExpBits);
+
+    /**
+     * modular exponentiation: base^e mod modulus
+     * Gives the same result as base.pow_mod(e, modulus).
+     */
+    CBigNum pow_mod(const CBigNum& e) const;
+
+  private:
+    static const unsigned int WINDOW_BITS = 4;
+    static const unsigned int WINDOW_SIZE = (1 << WINDOW_BITS) - 1;
+
+    CBigNum base;
+    const MontgomeryContext& mont;
+    unsigned int nMaxExpBits;
+
+    //! table[i * WINDOW_SIZE + j - 1] = base^(j * 2^(WINDOW_BITS * i)) in Montgomery form
+    std::vector<CBigNum> table;
+};
+
+} /* namespace libzerocoin */
+
+#endif /* FIXEDBASEEXP_H_ */
@@ -12,6 +12,15 @@
 // Copyright (c) 2017 The PIVX developers
 #include <streams.h>
 #include "SerialNumberSignatureOfKnowledge.h"
+#include "FixedBaseExp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+
+#include <boost/thread.hpp>
 
 namespace libzerocoin {
 
@@ -121,31 +130,227 @@ inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBig
     return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
 }
 
-bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
-        const uint256 msghash) const {
-    CBigNum a = params->coinCommitmentGroup.g;
-    CBigNum b = params->coinCommitmentGroup.h;
-    CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-    CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-    CHashWriter hasher(0,0);
-    hasher << *params << valueOfCommitmentToCoin << coinSerialNumber << msghash;
+/**
+ * Exponentiation state for the group generators used by Verify(). The Montgomery
+ * contexts and fixed-base tables only depend on the parameters, so they are built
+ * once per ZerocoinParams and shared by all verifications.
+ */
+class SerialNumberSoKVerifyTables {
+  public:
+    explicit SerialNumberSoKVerifyTables(const ZerocoinParams* p) :
+        montOrder(p->serialNumberSoKCommitmentGroup.groupOrder),
+        montModulus(p->serialNumberSoKCommitmentGroup.modulus),
+        a(p->coinCommitmentGroup.g, montOrder, p->serialNumberSoKCommitmentGroup.groupOrder.bitSize()),
+        b(p->coinCommitmentGroup.h, montOrder, p->serialNumberSoKCommitmentGroup.groupOrder.bitSize()),
+        g(p->serialNumberSoKCommitmentGroup.g, montModulus, p->serialNumberSoKCommitmentGroup.modulus.bitSize()),
+        h(p->serialNumberSoKCommitmentGroup.h, montModulus, p->serialNumberSoKCommitmentGroup.modulus.bitSize()),
+        group(p->serialNumberSoKCommitmentGroup), coinG(p->coinCommitmentGroup.g), coinH(p->coinCommitmentGroup.h) {}
 
-    vector<CBigNum> tprime(params->zkp_iterations);
-    unsigned char *hashbytes = (unsigned char*) &this->hash;
+    //! Whether the tables were built for the values in p
+    bool Matches(const ZerocoinParams* p) const {
+        return group.g == p->serialNumberSoKCommitmentGroup.g && group.h == p->serialNumberSoKCommitmentGroup.h &&
+               group.modulus == p->serialNumberSoKCommitmentGroup.modulus && group.groupOrder == p->serialNumberSoKCommitmentGroup.groupOrder &&
+               coinG == p->coinCommitmentGroup.g && coinH == p->coinCommitmentGroup.h;
+    }
 
-    for(uint32_t i = 0; i < params->zkp_iterations; i++) {
+    //! arithmetic modulo the SoK group order (which is the coin commitment group modulus)
+    MontgomeryContext montOrder;
+    //! arithmetic modulo the SoK group modulus
+    MontgomeryContext montModulus;
+    FixedBaseExp a;
+    FixedBaseExp b;
+    FixedBaseExp g;
+    FixedBaseExp h;
+
+  private:
+    IntegerGroupParams group;
+    CBigNum coinG;
+    CBigNum coinH;
+};
+
+static const SerialNumberSoKVerifyTables& GetVerifyTables(const ZerocoinParams* params) {
+    static boost::mutex cs_tables;
+    static std::map<const ZerocoinParams*, std::unique_ptr<SerialNumberSoKVerifyTables> > mapTables;
+    static std::vector<std::unique_ptr<SerialNumberSoKVerifyTables> > vRetiredTables;
+
+    boost::lock_guard<boost::mutex> lock(cs_tables);
+    std::unique_ptr<SerialNumberSoKVerifyTables>& ptables = mapTables[params];
+    // A params object may be freed and another one with other values allocated in its place. The old
+    // tables are kept rather than replaced, a Verify() still running with them may reference them.
+    if (!ptables || !ptables->Matches(params)) {
+        if (ptables)
+            vRetiredTables.push_back(std::move(ptables));
+        ptables.reset(new SerialNumberSoKVerifyTables(params));
+    }
+    return *ptables;
+}
+
+/**
+ * Helper threads shared by every Verify() call, started by StartSoKVerifyThreads(). Proofs
+ * verified concurrently (e.g. by the zerocoin check queue) neither start threads per call nor
+ * run more helpers between them than the application asked for.
+ */
+class SoKVerifyPool {
+  public:
+    static SoKVerifyPool& Get() {
+        // Never deleted, helpers of an application that doesn't stop them wait on it until it exits
+        static SoKVerifyPool* ppool = new SoKVerifyPool();
+        return *ppool;
+    }
+
+    //! Number of running helper threads, 0 if none were started
+    uint32_t Size() const {
+        return nThreads;
+    }
+
+    void Start(boost::thread_group& threadGroup, int nThreadsNew) {
+        for (int i = 0; i < nThreadsNew; i++) {
+            nThreads++;
+            threadGroup.create_thread(boost::bind(&SoKVerifyPool::Run, this));
+        }
+    }
+
+    void Post(const boost::function<void()>& task) {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            queue.push_back(task);
+        }
+        cond.notify_one();
+    }
+
+  private:
+    std::atomic<uint32_t> nThreads;
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<boost::function<void()> > queue;
+
+    SoKVerifyPool() : nThreads(0) {}
+
+    void Run() {
+        try {
+            while (true) {
+                boost::function<void()> task;
+                {
+                    boost::unique_lock<boost::mutex> lock(cs);
+                    // wait() is an interruption point, so the helpers stop with the rest of the thread group
+                    while (queue.empty())
+                        cond.wait(lock);
+                    task.swap(queue.front());
+                    queue.pop_front();
+                }
+                task();
+            }
+        } catch (const boost::thread_interrupted&) {
+            // Tasks left in the queue are jobs their callers finish on their own, see SoKVerifyJob
+            nThreads--;
+            throw;
+        }
+    }
+};
+
+void StartSoKVerifyThreads(boost::thread_group& threadGroup, int nThreads) {
+    SoKVerifyPool::Get().Start(threadGroup, nThreads);
+}
+
+/**
+ * Ranges of iterations of one Verify() call. Whoever runs Work() claims ranges until none are
+ * left, so a helper that only gets to the job after the caller finished it does nothing.
+ * A range is only computed after it was claimed, and the caller waits for every claimed range,
+ * so the data referenced by fnRange is never used after Verify() returned.
+ */
+struct SoKVerifyJob {
+    const uint32_t nRanges;
+    const boost::function<void(uint32_t)> fnRange;
+    std::atomic<uint32_t> nNext;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    uint32_t nDone;
+    bool fFailed;
+    std::string strError;
+
+    SoKVerifyJob(uint32_t nRangesIn, const boost::function<void(uint32_t)>& fnRangeIn) : nRanges(nRangesIn), fnRange(fnRangeIn),
+        nNext(0), nDone(0), fFailed(false) {}
+
+    void Work() {
+        for (uint32_t nRange = nNext++; nRange < nRanges; nRange = nNext++) {
+            std::string strRangeError;
+            try {
+                fnRange(nRange);
+            } catch (const std::exception& e) {
+                strRangeError = e.what();
+                if (strRangeError.empty())
+                    strRangeError = "unknown error";
+            }
+
+            boost::lock_guard<boost::mutex> lock(cs);
+            if (!strRangeError.empty() && !fFailed) {
+                fFailed = true;
+                strError = strRangeError;
+            }
+            if (++nDone == nRanges)
+                cond.notify_all();
+        }
+    }
+
+    void Wait() {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nDone < nRanges)
+            cond.wait(lock);
+    }
+};
+
+void SerialNumberSignatureOfKnowledge::VerifyIterations(const SerialNumberSoKVerifyTables& tables, const CBigNum& coinSerialNumber,
+        const CBigNum& valueOfCommitmentToCoin, uint32_t nBegin, uint32_t nEnd, vector<CBigNum>& tprime) const {
+    const CBigNum& order = params->serialNumberSoKCommitmentGroup.groupOrder;
+    const CBigNum& modulus = params->serialNumberSoKCommitmentGroup.modulus;
+    const unsigned char *hashbytes = (const unsigned char*) &this->hash;
+
+    for(uint32_t i = nBegin; i < nEnd; i++) {
         int bit = i % 8;
         int byte = i / 8;
         bool challenge_bit = ((hashbytes[byte] >> bit) & 0x01);
         if(challenge_bit) {
-            tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
+            // same as challengeCalculation(coinSerialNumber, s_notprime[i], SeedTo1024(sprime[i].getuint256()))
+            CBigNum exponent = (tables.a.pow_mod(coinSerialNumber) * tables.b.pow_mod(s_notprime[i])) % order;
+            tprime[i] = (tables.g.pow_mod(exponent) * tables.h.pow_mod(SeedTo1024(sprime[i].getuint256()))) % modulus;
         } else {
-            CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-            tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus) *
-                         (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus)) %
-                        params->serialNumberSoKCommitmentGroup.modulus;
+            CBigNum exp = tables.b.pow_mod(s_notprime[i]);
+            tprime[i] = ((tables.montModulus.pow_mod(valueOfCommitmentToCoin, exp) % modulus) *
+                         (tables.h.pow_mod(sprime[i]) % modulus)) % modulus;
         }
     }
+}
+
+bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
+        const uint256 msghash) const {
+    const SerialNumberSoKVerifyTables& tables = GetVerifyTables(params);
+    CHashWriter hasher(0,0);
+    hasher << *params << valueOfCommitmentToCoin << coinSerialNumber << msghash;
+
+    // Proofs with a malformed number of responses can not be valid
+    if (s_notprime.size() < params->zkp_iterations || sprime.size() < params->zkp_iterations)
+        return false;
+
+    vector<CBigNum> tprime(params->zkp_iterations);
+
+    // The iterations are independent of each other, so they are computed in
+    // contiguous ranges by this thread and the shared helper threads. Only hashing the results has to be in order.
+    uint32_t nRanges = std::max<uint32_t>(1, std::min<uint32_t>(SoKVerifyPool::Get().Size() + 1, params->zkp_iterations / SOK_MIN_ITERATIONS_PER_THREAD));
+    uint32_t nPerRange = (params->zkp_iterations + nRanges - 1) / nRanges;
+    std::shared_ptr<SoKVerifyJob> job(new SoKVerifyJob(nRanges, [this, &tables, &coinSerialNumber, &valueOfCommitmentToCoin, nPerRange, &tprime](uint32_t nRange) {
+        uint32_t nBegin = std::min(nRange * nPerRange, params->zkp_iterations);
+        uint32_t nEnd = std::min(nBegin + nPerRange, params->zkp_iterations);
+        VerifyIterations(tables, coinSerialNumber, valueOfCommitmentToCoin, nBegin, nEnd, tprime);
+    }));
+    for (uint32_t i = 1; i < nRanges; i++)
+        SoKVerifyPool::Get().Post(boost::bind(&SoKVerifyJob::Work, job));
+    job->Work();
+    job->Wait();
+
+    if (job->fFailed)
+        throw bignum_error("SerialNumberSignatureOfKnowledge::Verify : " + job->strError);
+
     for(uint32_t i = 0; i < params->zkp_iterations; i++) {
         hasher << tprime[i];
     }
@@ -27,8 +27,24 @@
 #include "hash.h"
 
 using namespace std;
+
+namespace boost {
+class thread_group;
+} // namespace boost
+
 namespace libzerocoin {
 
+class SerialNumberSoKVerifyTables;
+
+/** Verify() does not split the iterations into ranges smaller than this */
+static const uint32_t SOK_MIN_ITERATIONS_PER_THREAD = 8;
+
+/**
+ * Start nThreads helper threads in threadGroup that Verify() spreads its iterations over.
+ * Without them Verify() runs on the calling thread. The helpers stop when threadGroup is interrupted.
+ */
+void StartSoKVerifyThreads(boost::thread_group& threadGroup, int nThreads);
+
 /**
  * A Signature of knowledge on the hash of metadata attesting that the signer knows the values
  *  necessary to open a commitment which contains a coin(which it self is of course a commitment)
@@ -73,6 +89,9 @@ class SerialNumberSignatureOfKnowledge {
     vector<CBigNum> sprime;
     inline CBigNum challengeCalculation(const CBigNum& a_exp, const CBigNum& b_exp,
                                         const CBigNum& h_exp) const;
+    /** Compute the verification values tprime[nBegin..nEnd) */
+    void VerifyIterations(const SerialNumberSoKVerifyTables& tables, const CBigNum& coinSerialNumber,
+                          const CBigNum& valueOfCommitmentToCoin, uint32_t nBegin, uint32_t nEnd, vector<CBigNum>& tprime) const;
 };
 
 } /* namespace libzerocoin */
@@ -36,13 +36,23 @@
 #include "primitives/zerocoin.h"
 #include "libzerocoin/Denominations.h"
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using namespace boost;
 using namespace std;
 using namespace libzerocoin;
@@ -63,6 +73,52 @@ CCriticalSection cs_main;
 CCriticalSection cs_mapstake;
 
 BlockMap mapBlockIndex;
+
+namespace {
+/**
+ * Storage for the entries of mapBlockIndex. Entries are constructed in place in large chunks,
+ * so loading millions of them costs a few hundred heap allocations instead of one per entry.
+ * Entries are never freed individually and stay put until Clear(). Protected by cs_main.
+ */
+class CBlockIndexArena {
+  private:
+    static const size_t ENTRIES_PER_CHUNK = 4096;
+    std::vector<CBlockIndex*> vChunks;
+    //! entries used in the last chunk
+    size_t nUsed;
+
+  public:
+    CBlockIndexArena() : nUsed(ENTRIES_PER_CHUNK) {}
+    ~CBlockIndexArena() {
+        Clear();
+    }
+
+    template <typename... Args>
+    CBlockIndex* New(const Args&... args) {
+        if (nUsed == ENTRIES_PER_CHUNK) {
+            vChunks.push_back(static_cast<CBlockIndex*>(::operator new(ENTRIES_PER_CHUNK * sizeof(CBlockIndex))));
+            nUsed = 0;
+        }
+        CBlockIndex* pindex = new (vChunks.back() + nUsed) CBlockIndex(args...);
+        nUsed++;
+        return pindex;
+    }
+
+    void Clear() {
+        for (size_t i = 0; i < vChunks.size(); i++) {
+            size_t nEntries = i + 1 == vChunks.size() ? nUsed : ENTRIES_PER_CHUNK;
+            for (size_t j = 0; j < nEntries; j++)
+                vChunks[i][j].~CBlockIndex();
+            ::operator delete(vChunks[i]);
+        }
+        vChunks.clear();
+        nUsed = ENTRIES_PER_CHUNK;
+    }
+};
+
+CBlockIndexArena blockIndexArena;
+} // anon namespace
+
 map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 
@@ -346,6 +402,13 @@ void UpdatePreferredDownload(CNode* node, CNodeState* state) {
     nPreferredDownload += state->fPreferredDownload;
 }
 
+namespace {
+//! Set on threads that handle messages without cs_main, their Misbehaving() scores are applied by SendMessages
+boost::thread_specific_ptr<bool> pfDeferMisbehavior;
+boost::mutex csPendingMisbehavior;
+map<NodeId, int> mapPendingMisbehavior;
+} // anon namespace
+
 void InitializeNode(NodeId nodeid, const CNode* pnode) {
     LOCK(cs_main);
     CNodeState& state = mapNodeState.insert(std::make_pair(nodeid, CNodeState())).first->second;
@@ -369,6 +432,10 @@ void FinalizeNode(NodeId nodeid) {
     }
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    {
+        boost::lock_guard<boost::mutex> lock(csPendingMisbehavior);
+        mapPendingMisbehavior.erase(nodeid);
+    }
 
     mapNodeState.erase(nodeid);
 }
@@ -1184,6 +1251,25 @@ bool BlockToPubcoinList(const CBlock& block, list<PublicCoin>& listPubcoins) {
     return true;
 }
 
+bool GetBlockPubcoins(const CBlockIndex* pindex, list<PublicCoin>& listPubcoins) {
+    // an entry, empty or not, exists for every block connected since the mint index was added
+    if (zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), listPubcoins))
+        return true;
+
+    // blocks connected before the mint index existed are read from disk once and indexed
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s : failed to read block %d from disk", __func__, pindex->nHeight);
+
+    if (!BlockToPubcoinList(block, listPubcoins))
+        return error("%s : failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+
+    if (!zerocoinDB->WriteBlockMints(pindex->GetBlockHash(), listPubcoins))
+        LogPrintf("%s : failed to index the mints of block %d\n", __func__, pindex->nHeight);
+
+    return true;
+}
+
 //return a list of zerocoin mints contained in a specific block
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints) {
     for (const CTransaction tx : block.vtx) {
@@ -1288,7 +1374,21 @@ bool IsZerocoinSpendUnknown(CoinSpend coinSpend, uint256 hashTx, CValidationStat
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state) {
+/** Send signal to wallet for every spend of one of its zerocoin mints, only once the spends verified */
+static void NotifyZerocoinSpends(const CTransaction& tx, const list<CoinSpend>& vSpends) {
+    if (!pwalletMain)
+        return;
+
+    for (const auto& newSpend : vSpends) {
+        const CBigNum& bnSerial = newSpend.getCoinSerialNumber();
+        if (pwalletMain->IsMyZerocoinSerial(bnSerial)) {
+            LogPrintf("%s: %s detected spent zerocoin mint in transaction %s \n", __func__, bnSerial.GetHex(), tx.GetHash().GetHex());
+            pwalletMain->QueueZerocoinSpendNotification(bnSerial);
+        }
+    }
+}
+
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks) {
     if(GetAdjustedTime() < GetSporkValue(SPORK_21_ENABLE_ZEROCOIN))
         return state.DoS(100, error("CheckZerocoinSpend(): Zerocoin transactions are not allowed yet"));
 
@@ -1314,6 +1414,7 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
     bool fValidated = false;
     set<CBigNum> serials;
     list<CoinSpend> vSpends;
+    std::vector<CZerocoinSpendCheck> vChecks;
     CAmount nTotalRedeemed = 0;
     for (const CTxIn& txin : tx.vin) {
 
@@ -1343,11 +1444,10 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
             if(!zerocoinDB->ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue))
                 return state.DoS(100, error("Zerocoinspend could not find accumulator associated with checksum"));
 
-            Accumulator accumulator(Params().Zerocoin_Params(), newSpend.getDenomination(), bnAccumulatorValue);
-
-            //Check that the coin is on the accumulator
-            if(!newSpend.Verify(accumulator))
-                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            //Check that the coin is on the accumulator, the proof itself is verified in parallel below
+            vChecks.push_back(CZerocoinSpendCheck());
+            CZerocoinSpendCheck check(newSpend, bnAccumulatorValue);
+            check.swap(vChecks.back());
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1364,23 +1464,22 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
         return state.DoS(100, error("Transaction spend more than was redeemed in zerocoins"));
     }
 
-    // Send signal to wallet if this is ours
-    if (pwalletMain) {
-        CWalletDB walletdb(pwalletMain->strWalletFile);
-        list <CBigNum> listMySerials = walletdb.ListMintedCoinsSerial();
-        for (const auto& newSpend : vSpends) {
-            list<CBigNum>::iterator it = find(listMySerials.begin(), listMySerials.end(), newSpend.getCoinSerialNumber());
-            if (it != listMySerials.end()) {
-                LogPrintf("%s: %s detected spent zerocoin mint in transaction %s \n", __func__, it->GetHex(), tx.GetHash().GetHex());
-                pwalletMain->NotifyZerocoinChanged(pwalletMain, it->GetHex(), "Used", CT_UPDATED);
-            }
+    // Queued proofs are verified by the caller, which also notifies the wallet once they did
+    if (pvChecks) {
+        for (CZerocoinSpendCheck& check : vChecks) {
+            pvChecks->push_back(CZerocoinSpendCheck());
+            check.swap(pvChecks->back());
         }
+    } else if (!VerifyZerocoinSpendChecks(vChecks)) {
+        return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+    } else {
+        NotifyZerocoinSpends(tx, vSpends);
     }
 
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state) {
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks) {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
         return state.DoS(10, error("CheckTransaction() : vin empty"),
@@ -1437,7 +1536,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, pvZerocoinChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1753,6 +1852,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         pool.addUnchecked(hash, entry);
     }
 
+    mnCollateralTracker.SyncTransaction(tx);
     SyncWithWallets(tx, NULL);
 
     return true;
@@ -2039,19 +2139,201 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos) {
     return true;
 }
 
+/** Number of block files kept memory-mapped for ReadBlockFromDisk(), none where address space is scarce */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = sizeof(void*) >= 8 ? 32 : 0;
+
+namespace {
+/** Read-only memory mapping of a whole block file */
+class CMappedBlockFile {
+    const char* pdata;
+    size_t nLength;
+
+    CMappedBlockFile(const char* pdataIn, size_t nLengthIn) : pdata(pdataIn), nLength(nLengthIn) {}
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+  public:
+    ~CMappedBlockFile() {
+#ifndef WIN32
+        munmap((void*)pdata, nLength);
+#endif
+    }
+
+    const char* begin() const { return pdata; }
+    size_t size() const { return nLength; }
+
+    /** Map block file nFile as it is now. Returns an empty pointer if that is not possible on this platform */
+    static boost::shared_ptr<const CMappedBlockFile> Open(int nFile) {
+        boost::shared_ptr<const CMappedBlockFile> pmap;
+#ifndef WIN32
+        boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd < 0)
+            return pmap;
+        struct stat st;
+        void* p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p != MAP_FAILED)
+            pmap.reset(new CMappedBlockFile((const char*)p, st.st_size));
+#endif
+        return pmap;
+    }
+};
+
+/**
+ * The most recently read block files, memory-mapped, most recent first. Lets ReadBlockFromDisk()
+ * deserialize straight from the page cache instead of opening, seeking and reading the file every time.
+ * A mapping stays valid for as long as a reader holds on to it, even after it was dropped from here.
+ */
+class CBlockFileMaps {
+    CCriticalSection cs;
+    std::list<std::pair<int, boost::shared_ptr<const CMappedBlockFile> > > listMaps;
+
+  public:
+    /** Return a mapping of block file nFile that is at least nEnd bytes long, or an empty pointer */
+    boost::shared_ptr<const CMappedBlockFile> Get(int nFile, uint64_t nEnd) {
+        LOCK(cs);
+        boost::shared_ptr<const CMappedBlockFile> pmap;
+        for (std::list<std::pair<int, boost::shared_ptr<const CMappedBlockFile> > >::iterator it = listMaps.begin(); it != listMaps.end(); ++it) {
+            if (it->first == nFile) {
+                pmap = it->second;
+                listMaps.erase(it);
+                break;
+            }
+        }
+        // the file may have grown since it was mapped
+        if (!pmap || pmap->size() < nEnd)
+            pmap = CMappedBlockFile::Open(nFile);
+        if (!pmap)
+            return pmap;
+
+        listMaps.push_front(std::make_pair(nFile, pmap));
+        if (listMaps.size() > MAX_MAPPED_BLOCK_FILES)
+            listMaps.pop_back();
+        if (pmap->size() < nEnd)
+            return boost::shared_ptr<const CMappedBlockFile>();
+        return pmap;
+    }
+
+    /** Forget the mapping of block file nFile, to be called when the file is truncated */
+    void Erase(int nFile) {
+        LOCK(cs);
+        for (std::list<std::pair<int, boost::shared_ptr<const CMappedBlockFile> > >::iterator it = listMaps.begin(); it != listMaps.end(); ++it) {
+            if (it->first == nFile) {
+                listMaps.erase(it);
+                return;
+            }
+        }
+    }
+
+    void Clear() {
+        LOCK(cs);
+        listMaps.clear();
+    }
+};
+
+CBlockFileMaps blockFileMaps;
+} // anon namespace
+
+/**
+ * Locate the serialized block at pos in its mapped block file. pmap keeps the mapping alive for as long
+ * as the bytes are used. Returns false whenever that does not work out, in which case the caller reads
+ * the file the usual way.
+ */
+static bool GetMappedBlockData(const CDiskBlockPos& pos, boost::shared_ptr<const CMappedBlockFile>& pmap, const char*& pbegin, const char*& pend) {
+    // the block is preceded by the network magic and its size, see WriteBlockToDisk()
+    const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (MAX_MAPPED_BLOCK_FILES == 0 || pos.IsNull() || pos.nPos < nHeaderSize)
+        return false;
+
+    pmap = blockFileMaps.Get(pos.nFile, pos.nPos);
+    if (!pmap)
+        return false;
+
+    unsigned char buf[MESSAGE_START_SIZE];
+    unsigned int nSize = 0;
+    try {
+        CSpanStream header(pmap->begin() + pos.nPos - nHeaderSize, pmap->begin() + pos.nPos, SER_DISK, CLIENT_VERSION);
+        header >> FLATDATA(buf) >> nSize;
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+        return false;
+
+    if (pmap->size() < (uint64_t)pos.nPos + nSize) {
+        pmap = blockFileMaps.Get(pos.nFile, (uint64_t)pos.nPos + nSize);
+        if (!pmap)
+            return false;
+    }
+    pbegin = pmap->begin() + pos.nPos;
+    pend = pbegin + nSize;
+    return true;
+}
+
+/** Read a block through the block file mappings, see GetMappedBlockData() */
+static bool ReadBlockFromMappedFile(CBlock& block, const CDiskBlockPos& pos) {
+    boost::shared_ptr<const CMappedBlockFile> pmap;
+    const char* pbegin;
+    const char* pend;
+    if (!GetMappedBlockData(pos, pmap, pbegin, pend))
+        return false;
+
+    try {
+        CSpanStream blockdata(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        blockdata >> block;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Send a block to a peer as the bytes stored in its block file. Blocks serialize the same way on disk
+ * and on the network, so this saves deserializing the block only to serialize it again. Returns false,
+ * without sending anything, if the block is not available from a block file mapping.
+ */
+static bool PushRawBlock(CNode* pfrom, const CBlockIndex* pindex) {
+    boost::shared_ptr<const CMappedBlockFile> pmap;
+    const char* pbegin;
+    const char* pend;
+    if (!GetMappedBlockData(pindex->GetBlockPos(), pmap, pbegin, pend))
+        return false;
+
+    // make sure the bytes belong to the requested block, as ReadBlockFromDisk() does
+    CBlockHeader header;
+    try {
+        CSpanStream headerdata(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        headerdata >> header;
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return false;
+
+    pfrom->PushMessage("block", CFlatData((void*)pbegin, (void*)pend));
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    if (!ReadBlockFromMappedFile(block, pos)) {
+        block.SetNull();
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
+
+        // Read block
+        try {
+            filein >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Check the header
@@ -2073,6 +2355,27 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex) {
     return true;
 }
 
+bool ReadBlockSpentOutputs(const CBlock& block, const CBlockIndex* pindex, std::vector<std::vector<CTxOut> >& vSpentOutputs) {
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || !pindex->pprev)
+        return false;
+
+    CBlockUndo blockUndo;
+    if (!blockUndo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
+        return false;
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s : block and undo data inconsistent", __func__);
+
+    vSpentOutputs.assign(block.vtx.size(), std::vector<CTxOut>());
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const std::vector<CTxInUndo>& vprevout = blockUndo.vtxundo[i - 1].vprevout;
+        vSpentOutputs[i].reserve(vprevout.size());
+        for (const CTxInUndo& txinundo : vprevout)
+            vSpentOutputs[i].push_back(txinundo.txout);
+    }
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits) {
     int nShift = (nBits >> 24) & 0xff;
@@ -2535,11 +2838,31 @@ void CheckForkWarningConditionsOnNewFork(CBlockIndex* pindexNewForkTip) {
     CheckForkWarningConditions();
 }
 
+/** Apply the misbehavior scores deferred for a node, requires cs_main */
+static void ApplyPendingMisbehavior(NodeId nodeid) {
+    int howmuch = 0;
+    {
+        boost::lock_guard<boost::mutex> lock(csPendingMisbehavior);
+        map<NodeId, int>::iterator mi = mapPendingMisbehavior.find(nodeid);
+        if (mi == mapPendingMisbehavior.end())
+            return;
+        howmuch = mi->second;
+        mapPendingMisbehavior.erase(mi);
+    }
+    Misbehaving(nodeid, howmuch);
+}
+
 // Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch) {
     if (howmuch == 0)
         return;
 
+    if (pfDeferMisbehavior.get()) {
+        boost::lock_guard<boost::mutex> lock(csPendingMisbehavior);
+        mapPendingMisbehavior[pnode] += howmuch;
+        return;
+    }
+
     CNodeState* state = State(pnode);
     if (state == NULL)
         return;
@@ -2728,6 +3051,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    if (!zerocoinDB->EraseBlockMints(pindex->GetBlockHash()))
+        return error("DisconnectBlock(): Failed to erase the mint index of the block");
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -2850,8 +3176,10 @@ void static FlushBlockFile(bool fFinalize = false) {
 
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            blockFileMaps.Erase(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2874,68 +3202,166 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+// Each CoinSpend proof is expensive on its own, so hand them out to workers one at a time
+static CCheckQueue<CZerocoinSpendCheck> zerocoincheckqueue(1);
+// The check queue supports a single master at a time, blocks and mempool transactions may be checked concurrently
+static CCriticalSection cs_zerocoincheckqueue;
+
+void ThreadZerocoinCheck() {
+    RenameThread("idchain-zcspendch");
+    zerocoincheckqueue.Thread();
+}
+
+bool CZerocoinSpendCheck::operator()() {
+    Accumulator accumulator(Params().Zerocoin_Params(), pspend->getDenomination(), bnAccumulatorValue);
+    return pspend->Verify(accumulator);
+}
+
+bool VerifyZerocoinSpendChecks(std::vector<CZerocoinSpendCheck>& vChecks) {
+    if (vChecks.size() < 2 || !nScriptCheckThreads) {
+        for (CZerocoinSpendCheck& check : vChecks) {
+            if (!check())
+                return false;
+        }
+        return true;
+    }
+
+    LOCK(cs_zerocoincheckqueue);
+    CCheckQueueControl<CZerocoinSpendCheck> control(&zerocoincheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+/** Number of blocks read in parallel before their results are applied in chain order */
+static const int RECALCULATE_BLOCKS_PER_BATCH = 1000;
+
+/**
+ * Read the blocks of the active chain between nHeightFirst and nHeightLast on several threads and
+ * call fnBlock for each of them. fnBlock runs on the reader threads, in no particular order, and may
+ * only modify the block index entry it is given.
+ */
+static void ReadChainBlocksParallel(int nHeightFirst, int nHeightLast, const boost::function<void(const CBlock&, CBlockIndex*)>& fnBlock) {
+    std::atomic<int> nNextHeight(nHeightFirst);
+    auto readBlocks = [&]() {
+        for (int nHeight = nNextHeight++; nHeight <= nHeightLast; nHeight = nNextHeight++) {
+            CBlockIndex* pindex = chainActive[nHeight];
+            CBlock block;
+            assert(ReadBlockFromDisk(block, pindex));
+            fnBlock(block, pindex);
+        }
+    };
+
+    boost::thread_group threads;
+    for (int i = 1; i < std::max(nScriptCheckThreads, 1); i++)
+        threads.create_thread(readBlocks);
+    readBlocks();
+    threads.join_all();
+}
+
+/**
+ * Sum of the values spent by the transactions of a block, taken from the undo data written when the
+ * block was connected. Returns false when the undo data does not cover every input.
+ */
+static bool GetBlockValueInFromUndo(const CBlock& block, const CBlockIndex* pindex, CAmount& nValueIn) {
+    std::vector<std::vector<CTxOut> > vSpentOutputs;
+    if (!ReadBlockSpentOutputs(block, pindex, vSpentOutputs))
+        return false;
+
+    nValueIn = 0;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            if (tx.vin[j].scriptSig.IsZerocoinSpend()) {
+                nValueIn += tx.vin[j].nSequence * COIN;
+                continue;
+            }
+
+            if (j >= vSpentOutputs[i].size())
+                return false;
+            nValueIn += vSpentOutputs[i][j].nValue;
+        }
+    }
+
+    return true;
+}
+
+//! Sum of the values spent by the transactions of a block, looking up every previous transaction
+static CAmount GetBlockValueInSlow(const CBlock& block) {
+    CAmount nValueIn = 0;
+    for (const CTransaction& tx : block.vtx) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            if (tx.IsCoinBase())
+                break;
+
+            if (tx.vin[i].scriptSig.IsZerocoinSpend()) {
+                nValueIn += tx.vin[i].nSequence * COIN;
+                continue;
+            }
+
+            COutPoint prevout = tx.vin[i].prevout;
+            CTransaction txPrev;
+            uint256 hashBlock;
+            assert(GetTransaction(prevout.hash, txPrev, hashBlock, true));
+            nValueIn += txPrev.vout[prevout.n].nValue;
+        }
+    }
+
+    return nValueIn;
+}
+
 void RecalculateZIDCMinted() {
     int nZerocoinStartHeight = GetZerocoinStartHeight();
     if (nZerocoinStartHeight == 0) return;
-    CBlockIndex *pindex = chainActive[nZerocoinStartHeight];
     int nHeightEnd = chainActive.Height();
-    while (true) {
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
+    for (int nHeight = nZerocoinStartHeight; nHeight <= nHeightEnd; nHeight += RECALCULATE_BLOCKS_PER_BATCH) {
+        LogPrintf("%s : block %d...\n", __func__, nHeight);
 
         //overwrite possibly wrong vMintsInBlock data
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        std::list<CZerocoinMint> listMints;
-        BlockToZerocoinMintList(block, listMints);
-
-        vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
-        for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+        ReadChainBlocksParallel(nHeight, std::min(nHeight + RECALCULATE_BLOCKS_PER_BATCH - 1, nHeightEnd), [](const CBlock& block, CBlockIndex* pindex) {
+            std::list<CZerocoinMint> listMints;
+            BlockToZerocoinMintList(block, listMints);
 
-        if (pindex->nHeight < nHeightEnd)
-            pindex = chainActive.Next(pindex);
-        else
-            break;
+            pindex->vMintDenominationsInBlock.clear();
+            for (auto mint : listMints)
+                pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+        });
     }
 }
 
 void RecalculateZIDCSpent() {
     int nZerocoinStartHeight = GetZerocoinStartHeight();
     if (nZerocoinStartHeight == 0) return;
-    CBlockIndex* pindex = chainActive[nZerocoinStartHeight];
-    while (true) {
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
-
-        //Rewrite zIDC supply
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block);
+    int nHeightEnd = chainActive.Height();
+    for (int nHeight = nZerocoinStartHeight; nHeight <= nHeightEnd; nHeight += RECALCULATE_BLOCKS_PER_BATCH) {
+        LogPrintf("%s : block %d...\n", __func__, nHeight);
+
+        int nHeightLast = std::min(nHeight + RECALCULATE_BLOCKS_PER_BATCH - 1, nHeightEnd);
+        std::vector<list<libzerocoin::CoinDenomination> > vDenomsSpent(nHeightLast - nHeight + 1);
+        ReadChainBlocksParallel(nHeight, nHeightLast, [&](const CBlock& block, CBlockIndex* pindex) {
+            vDenomsSpent[pindex->nHeight - nHeight] = ZerocoinSpendListFromBlock(block);
+        });
+
+        // the supply of each block builds on the previous one, so it is applied in chain order
+        std::vector<CBlockIndex*> vBlockIndex;
+        for (CBlockIndex* pindex = chainActive[nHeight]; pindex && pindex->nHeight <= nHeightLast; pindex = chainActive.Next(pindex)) {
+            //Reset the supply to previous block
+            pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+
+            //Add mints to zIDC supply
+            for (auto denom : libzerocoin::zerocoinDenomList) {
+                long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+                pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            }
 
-        //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+            //Remove spends from zIDC supply
+            for (auto denom : vDenomsSpent[pindex->nHeight - nHeight])
+                pindex->mapZerocoinSupply.at(denom)--;
 
-        //Add mints to zIDC supply
-        for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            vBlockIndex.push_back(pindex);
         }
 
-        //Remove spends from zIDC supply
-        for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
-
         //Rewrite money supply
-        assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
-
-        if (pindex->nHeight < chainActive.Height())
-            pindex = chainActive.Next(pindex);
-        else
-            break;
+        assert(pblocktree->WriteBlockIndexes(vBlockIndex));
     }
 }
 
@@ -2943,53 +3369,49 @@ bool RecalculateIDCSupply(int nHeightStart) {
     if (nHeightStart > chainActive.Height())
         return false;
 
-    CBlockIndex* pindex = chainActive[nHeightStart];
-    CAmount nSupplyPrev = pindex->pprev->nMoneySupply;
-
-    while (true) {
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
-
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (const CTransaction tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
+    int nHeightEnd = chainActive.Height();
+    CAmount nSupplyPrev = chainActive[nHeightStart]->pprev->nMoneySupply;
+    for (int nHeight = nHeightStart; nHeight <= nHeightEnd; nHeight += RECALCULATE_BLOCKS_PER_BATCH) {
+        LogPrintf("%s : block %d...\n", __func__, nHeight);
+
+        // -1 marks a block without usable undo data, its inputs are looked up below
+        int nHeightLast = std::min(nHeight + RECALCULATE_BLOCKS_PER_BATCH - 1, nHeightEnd);
+        std::vector<CAmount> vValueIn(nHeightLast - nHeight + 1, -1);
+        std::vector<CAmount> vValueOut(nHeightLast - nHeight + 1, 0);
+        ReadChainBlocksParallel(nHeight, nHeightLast, [&](const CBlock& block, CBlockIndex* pindex) {
+            int nOffset = pindex->nHeight - nHeight;
+            CAmount nValueIn = 0;
+            if (GetBlockValueInFromUndo(block, pindex, nValueIn))
+                vValueIn[nOffset] = nValueIn;
+
+            CAmount nValueOut = 0;
+            for (const CTransaction& tx : block.vtx) {
+                for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                    if (i == 0 && tx.IsCoinStake())
+                        continue;
 
-                if (tx.vin[i].scriptSig.IsZerocoinSpend()) {
-                    nValueIn += tx.vin[i].nSequence * COIN;
-                    continue;
+                    nValueOut += tx.vout[i].nValue;
                 }
-
-                COutPoint prevout = tx.vin[i].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                assert(GetTransaction(prevout.hash, txPrev, hashBlock, true));
-                nValueIn += txPrev.vout[prevout.n].nValue;
             }
+            vValueOut[nOffset] = nValueOut;
+        });
 
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                if (i == 0 && tx.IsCoinStake())
-                    continue;
-
-                nValueOut += tx.vout[i].nValue;
+        std::vector<CBlockIndex*> vBlockIndex;
+        for (CBlockIndex* pindex = chainActive[nHeight]; pindex && pindex->nHeight <= nHeightLast; pindex = chainActive.Next(pindex)) {
+            int nOffset = pindex->nHeight - nHeight;
+            if (vValueIn[nOffset] < 0) {
+                CBlock block;
+                assert(ReadBlockFromDisk(block, pindex));
+                vValueIn[nOffset] = GetBlockValueInSlow(block);
             }
-        }
-
-        // Rewrite money supply
-        pindex->nMoneySupply = nSupplyPrev + nValueOut - nValueIn;
-        nSupplyPrev = pindex->nMoneySupply;
 
-        assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
+            // Rewrite money supply
+            pindex->nMoneySupply = nSupplyPrev + vValueOut[nOffset] - vValueIn[nOffset];
+            nSupplyPrev = pindex->nMoneySupply;
+            vBlockIndex.push_back(pindex);
+        }
 
-        if (pindex->nHeight < chainActive.Height())
-            pindex = chainActive.Next(pindex);
-        else
-            break;
+        assert(pblocktree->WriteBlockIndexes(vBlockIndex));
     }
     return true;
 }
@@ -3337,6 +3759,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    // Index every block, also those without mints, so readers never have to trust vMintDenominationsInBlock.
+    // A block whose mints don't parse gets no entry and is read from disk like before.
+    list<PublicCoin> listPubcoins;
+    if (BlockToPubcoinList(block, listPubcoins) && !zerocoinDB->WriteBlockMints(pindex->GetBlockHash(), listPubcoins))
+        return state.Abort("Failed to write zerocoin mint index");
+
     {
     	LOCK(cs_mapstake);
 
@@ -3451,6 +3879,7 @@ void FlushStateToDisk() {
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew) {
     chainActive.SetTip(pindexNew);
+    UpdateStakeModifierIndex();
 
     // If turned on AutoZeromint will automatically convert IDC to zIDC
     if (pwalletMain->isZeromintEnabled ())
@@ -3521,6 +3950,8 @@ bool static DisconnectTip(CValidationState& state) {
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    // Collaterals may be unspent again, or their outputs gone
+    mnCollateralTracker.Clear();
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     BOOST_FOREACH(const CTransaction& tx, block.vtx) {
@@ -3602,6 +4033,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     }
     // ... and about transactions that got confirmed:
     BOOST_FOREACH(const CTransaction& tx, pblock->vtx) {
+        mnCollateralTracker.SyncTransaction(tx);
         SyncWithWallets(tx, pblock);
     }
 
@@ -3970,8 +4402,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block) {
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -4322,8 +4753,9 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check transactions
     bool fZerocoinActive = block.nTime > GetSporkValue(SPORK_21_ENABLE_ZEROCOIN);
     vector<CBigNum> vBlockSerials;
+    std::vector<CZerocoinSpendCheck> vZerocoinChecks;
     for (const CTransaction& tx : block.vtx) {
-        if (!CheckTransaction(tx, fZerocoinActive, true, state))
+        if (!CheckTransaction(tx, fZerocoinActive, true, state, &vZerocoinChecks))
             return error("CheckBlock() : CheckTransaction failed");
 
         // double check that there are no double spent zIDC spends in this block
@@ -4340,6 +4772,23 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
+    // Verify the CoinSpend proofs of every zerocoinspend in the block at once
+    if (!VerifyZerocoinSpendChecks(vZerocoinChecks))
+        return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"));
+
+    if (fZerocoinActive) {
+        for (const CTransaction& tx : block.vtx) {
+            if (!tx.IsZerocoinSpend())
+                continue;
+            list<CoinSpend> vSpends;
+            for (const CTxIn& txin : tx.vin) {
+                if (txin.scriptSig.IsZerocoinSpend())
+                    vSpends.push_back(TxInToZerocoinSpend(txin));
+            }
+            NotifyZerocoinSpends(tx, vSpends);
+        }
+    }
+
 
     unsigned int nSigOps = 0;
     BOOST_FOREACH(const CTransaction& tx, block.vtx) {
@@ -4890,9 +5339,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash) {
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.New();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
     //mark as PoS seen
@@ -4910,17 +5357,23 @@ bool static LoadBlockIndexDB(string& strError) {
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const PAIRTYPE(uint256, CBlockIndex*) & item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+    // Calculate nChainWork, parents first. A counting sort on the height puts the entries in
+    // that order in linear time.
+    int nMaxHeight = 0;
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    vector<size_t> vHeightStart(nMaxHeight + 2, 0);
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        vHeightStart[item.second->nHeight + 1]++;
+    for (int nHeight = 1; nHeight <= nMaxHeight + 1; nHeight++)
+        vHeightStart[nHeight] += vHeightStart[nHeight - 1];
+    vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        vSortedByHeight[vHeightStart[item.second->nHeight]++] = item.second;
+
+    for (CBlockIndex* pindex : vSortedByHeight) {
+        // LoadBlockIndexGuts() left the proof of the block itself in nChainWork
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + pindex->nChainWork;
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
@@ -4984,7 +5437,7 @@ bool static LoadBlockIndexDB(string& strError) {
     //Check for inconsistency with block file info and internal state
     if (!fLastShutdownWasPrepared && !GetBoolArg("-forcestart", false) && !GetBoolArg("-reindex", false)) {
         unsigned int nHeightLastBlockFile = vinfoBlockFile[nLastBlockFile].nHeightLast + 1;
-        if (vSortedByHeight.size() > nHeightLastBlockFile && pcoinsTip->GetBestBlock() != vSortedByHeight[nHeightLastBlockFile].second->GetBlockHash()) {
+        if (vSortedByHeight.size() > nHeightLastBlockFile && pcoinsTip->GetBestBlock() != vSortedByHeight[nHeightLastBlockFile]->GetBlockHash()) {
             //The database is in a state where a block has been accepted and written to disk, but the
             //transaction database (pcoinsTip) was not flushed to disk, and is therefore not in sync with
             //the block index database.
@@ -4997,13 +5450,13 @@ bool static LoadBlockIndexDB(string& strError) {
                       mapBlockIndex[pcoinsTip->GetBestBlock()]->nHeight, vSortedByHeight.size());
 
             //get the index associated with the point in the chain that pcoinsTip is synced to
-            CBlockIndex *pindexLastMeta = vSortedByHeight[vinfoBlockFile[nLastBlockFile].nHeightLast + 1].second;
-            CBlockIndex *pindex = vSortedByHeight[0].second;
+            CBlockIndex *pindexLastMeta = vSortedByHeight[vinfoBlockFile[nLastBlockFile].nHeightLast + 1];
+            CBlockIndex *pindex = vSortedByHeight[0];
             unsigned int nSortedPos = 0;
             for (unsigned int i = 0; i < vSortedByHeight.size(); i++) {
                 nSortedPos = i;
-                if (vSortedByHeight[i].first == mapBlockIndex[pcoinsTip->GetBestBlock()]->nHeight + 1) {
-                    pindex = vSortedByHeight[i].second;
+                if (vSortedByHeight[i]->nHeight == mapBlockIndex[pcoinsTip->GetBestBlock()]->nHeight + 1) {
+                    pindex = vSortedByHeight[i];
                     break;
                 }
             }
@@ -5033,7 +5486,7 @@ bool static LoadBlockIndexDB(string& strError) {
                 if(pindex->nHeight >= pindexLastMeta->nHeight)
                     break;
 
-                pindex = vSortedByHeight[++nSortedPos].second;
+                pindex = vSortedByHeight[++nSortedPos];
             }
 
             // Save the updates to disk
@@ -5064,6 +5517,7 @@ bool static LoadBlockIndexDB(string& strError) {
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    UpdateStakeModifierIndex();
 
     PruneBlockIndexCandidates();
 
@@ -5163,6 +5617,7 @@ void UnloadBlockIndex() {
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    UpdateStakeModifierIndex();
     pindexBestInvalid = NULL;
 }
 
@@ -5213,19 +5668,51 @@ bool InitBlockIndex() {
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp) {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+/** Upper bounds for the blocks LoadExternalBlockFile() reads ahead while the previous batch is connected */
+static const unsigned int IMPORT_BLOCKS_PER_BATCH = 500;
+static const uint64_t IMPORT_BYTES_PER_BATCH = 32 * 1000 * 1000;
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+namespace {
+/** A block read from an external block file, decoded off the import thread */
+struct CImportBlock {
+    //! Position of the block data in the file
+    uint64_t nPos;
+    //! Where the header scan restarts if this block turns out to be corrupt
+    uint64_t nRewind;
+    //! The network magic occurs inside the block data, so the scan may have to restart in there
+    bool fEmbeddedMagic;
+    //! Number of bytes the block took to deserialize, 0 if that failed
+    uint64_t nDecodedSize;
+    std::vector<char> vData;
+    CBlock block;
+    uint256 hash;
+    std::string strError;
+
+    CImportBlock() : nPos(0), nRewind(0), fEmbeddedMagic(false), nDecodedSize(0) {}
+};
+
+/**
+ * Scans an external block file for blocks, one batch at a time. A batch is read on a separate thread
+ * while the previous one is processed, so the file is only ever accessed by one thread at a time.
+ */
+class CImportBlockReader {
+    CBufferedFile& blkdat;
+    uint64_t nRewind;
+    bool fEnd;
+
+  public:
+    explicit CImportBlockReader(CBufferedFile& blkdatIn) : blkdat(blkdatIn), nRewind(blkdatIn.GetPos()), fEnd(false) {}
+
+    /** Continue the header scan at nPos, which must not lie before the start of the last block read */
+    void Rewind(uint64_t nPos) { nRewind = nPos; }
 
+    /**
+     * Append the next blocks to vBlocks. A batch ends early with a block that contains the network magic:
+     * if it fails to decode the scan restarts inside it, so nothing past it may be read yet.
+     */
+    void ReadBatch(std::vector<CImportBlock>& vBlocks) {
+        uint64_t nBytes = 0;
+        while (!fEnd && !blkdat.eof() && vBlocks.size() < IMPORT_BLOCKS_PER_BATCH && nBytes < IMPORT_BYTES_PER_BATCH) {
             blkdat.SetPos(nRewind);
             nRewind++;         // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
@@ -5244,65 +5731,160 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp) {
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
+                fEnd = true;
                 break;
             }
             try {
                 // read block
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
+                std::vector<char> vData(nSize);
+                blkdat.read(&vData[0], nSize);
+
+                vBlocks.push_back(CImportBlock());
+                CImportBlock& entry = vBlocks.back();
+                entry.nPos = nBlockPos;
+                entry.nRewind = nRewind;
+                entry.vData.swap(vData);
+                entry.fEmbeddedMagic = std::search(entry.vData.begin(), entry.vData.end(),
+                    Params().MessageStart(), Params().MessageStart() + MESSAGE_START_SIZE) != entry.vData.end();
                 nRewind = blkdat.GetPos();
+                nBytes += nSize;
+                if (entry.fEmbeddedMagic)
+                    break;
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+    }
+};
+} // anon namespace
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                             block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+/** Deserialize a batch of blocks in parallel, which also hashes their transactions */
+static void DecodeImportBlocks(std::vector<CImportBlock>& vBlocks) {
+    std::atomic<size_t> nNext(0);
+    auto decodeBlocks = [&]() {
+        for (size_t i = nNext++; i < vBlocks.size(); i = nNext++) {
+            CImportBlock& entry = vBlocks[i];
+            try {
+                CDataStream ss(entry.vData, SER_DISK, CLIENT_VERSION);
+                ss >> entry.block;
+                entry.nDecodedSize = entry.vData.size() - ss.size();
+                entry.hash = entry.block.GetHash();
+            } catch (const std::exception& e) {
+                entry.nDecodedSize = 0;
+                entry.strError = e.what();
+            }
+            std::vector<char>().swap(entry.vData);
+        }
+    };
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+    boost::thread_group threads;
+    for (int i = 1; i < std::max(nScriptCheckThreads, 1); i++)
+        threads.create_thread(decodeBlocks);
+    decodeBlocks();
+    threads.join_all();
+}
+
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp) {
+    // Map of disk positions for blocks with unknown parent (only used for reindex)
+    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+        CImportBlockReader reader(blkdat);
+        std::vector<CImportBlock> vBlocks, vNextBlocks;
+        reader.ReadBatch(vBlocks);
+        bool fAbort = false;
+        while (!vBlocks.empty() && !fAbort) {
+            // Read the next batch while this one is decoded and connected, unless the scan may have to go back into it
+            boost::thread_group readerThread;
+            if (!vBlocks.back().fEmbeddedMagic)
+                readerThread.create_thread(boost::bind(&CImportBlockReader::ReadBatch, &reader, boost::ref(vNextBlocks)));
+
+            try {
+                DecodeImportBlocks(vBlocks);
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                      head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
+                for (CImportBlock& entry : vBlocks) {
+                    boost::this_thread::interruption_point();
+
+                    if (entry.fEmbeddedMagic)
+                        reader.Rewind(entry.nDecodedSize ? entry.nPos + entry.nDecodedSize : entry.nRewind);
+                    if (!entry.nDecodedSize) {
+                        LogPrintf("%s : Deserialize or I/O error - %s", __func__, entry.strError);
+                        continue;
+                    }
+
+                    try {
+                        if (dbp)
+                            dbp->nPos = entry.nPos;
+                        CBlock& block = entry.block;
+
+                        // detect out of order blocks, and store them for later
+                        const uint256& hash = entry.hash;
+                        if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                            LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                     block.hashPrevBlock.ToString());
+                            if (dbp)
+                                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                            continue;
+                        }
+
+                        // process in case the block isn't known yet
+                        if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                            CValidationState state;
+                            if (ProcessNewBlock(state, NULL, &block, dbp))
                                 nLoaded++;
-                                queue.push_back(block.GetHash());
+                            if (state.IsError()) {
+                                fAbort = true;
+                                break;
                             }
+                        } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                            LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
+
+                        // Recursively process earlier encountered successors of this block
+                        deque<uint256> queue;
+                        queue.push_back(hash);
+                        while (!queue.empty()) {
+                            uint256 head = queue.front();
+                            queue.pop_front();
+                            std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                            while (range.first != range.second) {
+                                std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                                CBlock blockChild;
+                                if (ReadBlockFromDisk(blockChild, it->second)) {
+                                    LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                                              head.ToString());
+                                    CValidationState dummy;
+                                    if (ProcessNewBlock(dummy, NULL, &blockChild, &it->second)) {
+                                        nLoaded++;
+                                        queue.push_back(blockChild.GetHash());
+                                    }
+                                }
+                                range.first++;
+                                mapBlocksUnknownParent.erase(it);
+                            }
+                        }
+                    } catch (std::exception& e) {
+                        LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
                     }
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            } catch (...) {
+                // the reader thread uses blkdat, which is about to go away
+                readerThread.join_all();
+                throw;
             }
+            readerThread.join_all();
+
+            vBlocks.swap(vNextBlocks);
+            vNextBlocks.clear();
+            if (vBlocks.empty())
+                reader.ReadBatch(vBlocks);
         }
     } catch (std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -5610,11 +6192,14 @@ void static ProcessGetData(CNode* pfrom) {
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
+                    // Send block from disk, straight from the block file when possible
+                    bool fSentRaw = inv.type == MSG_BLOCK && PushRawBlock(pfrom, (*mi).second);
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
+                    if (!fSentRaw && !ReadBlockFromDisk(block, (*mi).second))
                         assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
+                    if (fSentRaw) {
+                        // nothing left to do
+                    } else if (inv.type == MSG_BLOCK)
                         pfrom->PushMessage("block", block);
                     else { // MSG_FILTERED_BLOCK)
                         LOCK(pfrom->cs_filter);
@@ -6660,6 +7245,150 @@ int ActiveProtocol() {
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+/** Process one message, logging (rather than propagating) anything but thread interruption */
+static void HandleMessage(CNode* pfrom, const string& strCommand, CDataStream& vRecv, int64_t nTimeReceived) {
+    unsigned int nMessageSize = vRecv.size();
+    bool fRet = false;
+    try {
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, nTimeReceived);
+        boost::this_thread::interruption_point();
+    } catch (std::ios_base::failure& e) {
+        pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
+        if (strstr(e.what(), "end of data")) {
+            // Allow exceptions from under-length message on vRecv
+            LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", SanitizeString(strCommand), nMessageSize, e.what());
+        } else if (strstr(e.what(), "size too large")) {
+            // Allow exceptions from over-long size
+            LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught\n", SanitizeString(strCommand), nMessageSize, e.what());
+        } else {
+            PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    } catch (boost::thread_interrupted) {
+        throw;
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+
+    if (!fRet)
+        LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->GetId());
+}
+
+namespace {
+/**
+ * Masternode, budget and payment messages are handled on their own thread so they don't
+ * queue behind block and transaction validation. Their handlers serialize on their own
+ * locks and take cs_main with TRY_LOCK around block index and coins lookups, dropping the
+ * message for a later retry when it is busy. Their Misbehaving() scores are deferred to the
+ * message handler thread, see Misbehaving(). Budget proposals and finalized budgets check
+ * their collateral through IsBudgetCollateralValid(), which the budget validity checks share
+ * and which can't give up on a busy cs_main, so "mprop" and "fbs" stay on the ordered message
+ * handler. So does "mnw", whose masternode rank lookup walks chainActive through GetBlockHash().
+ * Sporks, SwiftTX and everything consensus related stay there too.
+ */
+bool IsMasternodeMessage(const string& strCommand) {
+    static const set<string> setCommands = {
+        "mnb", "mnp", "dseg", "dsee", "dseep",              // CMasternodeMan
+        "mnvs", "mvote", "fbvote",                          // CBudgetManager
+        "mnget",                                            // CMasternodePayments
+        "ssc"};                                             // CMasternodeSync
+    return setCommands.count(strCommand) > 0;
+}
+
+struct CQueuedMessage {
+    string strCommand;
+    CDataStream vRecv;
+    int64_t nTime;
+    //! Counted in CNode::nRecvQueuedSize until the message is handled
+    unsigned int nSize;
+
+    CQueuedMessage() : vRecv(SER_NETWORK, PROTOCOL_VERSION), nTime(0), nSize(0) {}
+    CQueuedMessage(const string& strCommandIn, const CDataStream& vRecvIn, int64_t nTimeIn) : strCommand(strCommandIn), vRecv(vRecvIn), nTime(nTimeIn),
+        nSize(vRecvIn.size() + CMessageHeader::HEADER_SIZE) {}
+};
+
+/**
+ * Per-peer FIFO queues, served round-robin so a chatty peer can't starve the others.
+ * Each queued peer holds a reference so it isn't deleted before its messages are handled.
+ */
+boost::mutex csMasternodeMessages;
+boost::condition_variable condMasternodeMessages;
+map<NodeId, pair<CNode*, deque<CQueuedMessage> > > mapMasternodeMessages;
+deque<NodeId> queueMasternodePeers;
+//! Without the masternode message thread (unit tests) messages are handled inline
+std::atomic<bool> fMasternodeMessageThread(false);
+} // anon namespace
+
+static bool QueueMasternodeMessage(CNode* pfrom, const string& strCommand, const CDataStream& vRecv, int64_t nTime) {
+    if (!fMasternodeMessageThread) {
+        CDataStream vRecvCopy(vRecv);
+        HandleMessage(pfrom, strCommand, vRecvCopy, nTime);
+        return true;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(csMasternodeMessages);
+        map<NodeId, pair<CNode*, deque<CQueuedMessage> > >::iterator mi = mapMasternodeMessages.find(pfrom->GetId());
+        if (mi == mapMasternodeMessages.end()) {
+            mi = mapMasternodeMessages.insert(make_pair(pfrom->GetId(), make_pair(pfrom->AddRef(), deque<CQueuedMessage>()))).first;
+            queueMasternodePeers.push_back(pfrom->GetId());
+        } else if (pfrom->nRecvQueuedSize + vRecv.size() + CMessageHeader::HEADER_SIZE > ReceiveFloodSize()) {
+            // Queued messages count against the receive buffer, one message is always let through.
+            // The peer's queue isn't empty, so ThreadMasternodeMessages will clear the flag.
+            pfrom->fRecvQueueFull = true;
+            return false;
+        }
+        mi->second.second.push_back(CQueuedMessage(strCommand, vRecv, nTime));
+        pfrom->nRecvQueuedSize += mi->second.second.back().nSize;
+    }
+    condMasternodeMessages.notify_one();
+    return true;
+}
+
+void ThreadMasternodeMessages() {
+    RenameThread("idchain-mnmsg");
+    pfDeferMisbehavior.reset(new bool(true));
+    fMasternodeMessageThread = true;
+
+    while (true) {
+        CNode* pfrom = NULL;
+        CQueuedMessage msg;
+        {
+            boost::unique_lock<boost::mutex> lock(csMasternodeMessages);
+            while (queueMasternodePeers.empty())
+                condMasternodeMessages.wait(lock);
+
+            NodeId id = queueMasternodePeers.front();
+            queueMasternodePeers.pop_front();
+            map<NodeId, pair<CNode*, deque<CQueuedMessage> > >::iterator mi = mapMasternodeMessages.find(id);
+            pfrom = mi->second.first;
+            msg = mi->second.second.front();
+            mi->second.second.pop_front();
+            // Keep the reference while the message is handled, the next one queued takes a new one
+            if (mi->second.second.empty())
+                mapMasternodeMessages.erase(mi);
+            else {
+                pfrom->AddRef();
+                queueMasternodePeers.push_back(id);
+            }
+        }
+
+        if (!pfrom->fDisconnect)
+            HandleMessage(pfrom, msg.strCommand, msg.vRecv, msg.nTime);
+        bool fWasFull;
+        {
+            boost::unique_lock<boost::mutex> lock(csMasternodeMessages);
+            pfrom->nRecvQueuedSize -= msg.nSize;
+            fWasFull = pfrom->fRecvQueueFull.exchange(false);
+        }
+        // Wake the message handler if it left this peer's next message waiting for room
+        if (fWasFull)
+            messageHandlerCondition.notify_one();
+        pfrom->Release();
+    }
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom) {
     //
@@ -6678,6 +7407,9 @@ bool ProcessMessages(CNode* pfrom) {
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // Don't hash the same waiting masternode message again before there is room for it
+    if (pfrom->fRecvQueueFull) return fOk;
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -6723,33 +7455,18 @@ bool ProcessMessages(CNode* pfrom) {
             continue;
         }
 
-        // Process message
-        bool fRet = false;
-        try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
-            boost::this_thread::interruption_point();
-        } catch (std::ios_base::failure& e) {
-            pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
-            if (strstr(e.what(), "end of data")) {
-                // Allow exceptions from under-length message on vRecv
-                LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", SanitizeString(strCommand), nMessageSize, e.what());
-            } else if (strstr(e.what(), "size too large")) {
-                // Allow exceptions from over-long size
-                LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught\n", SanitizeString(strCommand), nMessageSize, e.what());
-            } else {
-                PrintExceptionContinue(&e, "ProcessMessages()");
+        // Masternode messages don't need to wait for block and transaction validation
+        if (pfrom->nVersion != 0 && IsMasternodeMessage(strCommand)) {
+            if (!QueueMasternodeMessage(pfrom, strCommand, vRecv, msg.nTime)) {
+                // The peer's queue is full, leave the message until ThreadMasternodeMessages makes room
+                it--;
+                break;
             }
-        } catch (boost::thread_interrupted) {
-            throw;
-        } catch (std::exception& e) {
-            PrintExceptionContinue(&e, "ProcessMessages()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "ProcessMessages()");
+            continue;
         }
 
-        if (!fRet)
-            LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->GetId());
-
+        // Process message
+        HandleMessage(pfrom, strCommand, vRecv, msg.nTime);
         break;
     }
 
@@ -6800,6 +7517,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle) {
         if (!lockMain)
             return true;
 
+        ApplyPendingMisbehavior(pto->GetId());
+
         // Address refresh broadcast
         static int64_t nLastRebroadcast;
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
@@ -7049,10 +7768,11 @@ class CMainCleanup {
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
+
+        // block file mappings
+        blockFileMaps.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
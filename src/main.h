@@ -34,6 +34,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -51,6 +52,7 @@ class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -223,6 +225,10 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinCheck();
+/** Run the thread handling masternode, budget and payment messages */
+void ThreadMasternodeMessages();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -350,12 +356,23 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state);
+
+/**
+ * Check a zerocoinspend transaction. The CoinSpend proofs are the expensive part of the check:
+ * if pvChecks is not NULL they are appended to it so the caller can verify them in one batch,
+ * otherwise they are verified on the zerocoin check queue before returning.
+ */
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
+
+/** Verify a batch of CoinSpend proofs, spreading them over the zerocoin check threads */
+bool VerifyZerocoinSpendChecks(std::vector<CZerocoinSpendCheck>& vChecks);
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 bool BlockToPubcoinList(const CBlock& block, list<libzerocoin::PublicCoin>& listPubcoins);
+/** Pubcoins minted in a block, served from the zerocoin mint index and read from disk only for unindexed blocks */
+bool GetBlockPubcoins(const CBlockIndex* pindex, list<libzerocoin::PublicCoin>& listPubcoins);
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints);
 bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues);
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block);
@@ -440,11 +457,39 @@ class CScriptCheck {
     }
 };
 
+/**
+ * Closure representing the verification of one CoinSpend proof against the
+ * accumulator value referenced by its checksum.
+ */
+class CZerocoinSpendCheck {
+  private:
+    std::unique_ptr<libzerocoin::CoinSpend> pspend;
+    CBigNum bnAccumulatorValue;
+
+  public:
+    CZerocoinSpendCheck() {}
+    CZerocoinSpendCheck(const libzerocoin::CoinSpend& spendIn, const CBigNum& bnAccumulatorValueIn) : pspend(new libzerocoin::CoinSpend(spendIn)),
+        bnAccumulatorValue(bnAccumulatorValueIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check) {
+        pspend.swap(check.pspend);
+        std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/**
+ * Outputs spent by the transactions of a block, read from its undo data in one sequential read.
+ * vSpentOutputs[i][j] is the output spent by input j of transaction i. The coinbase and zerocoin
+ * spends do not spend outputs, so only entries whose size matches tx.vin.size() are complete.
+ */
+bool ReadBlockSpentOutputs(const CBlock& block, const CBlockIndex* pindex, std::vector<std::vector<CTxOut> >& vSpentOutputs);
 
 
 /** Functions for validating blocks and updating the block tree */
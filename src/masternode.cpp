@@ -15,6 +15,7 @@
 map<uint256, int> mapSeenMasternodeScanningErrors;
 // cache block hashes as we calculate them
 std::map<int64_t, uint256> mapCacheBlockHashes;
+CMasternodeCollateralTracker mnCollateralTracker;
 
 //Get the last hash that matches the modulus given. Processed in reverse order
 bool GetBlockHash(uint256& hash, int nBlockHeight) {
@@ -180,6 +181,53 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight) {
     return r;
 }
 
+bool CMasternodeCollateralTracker::GetSpent(const CTxIn& vin, bool& fSpent) {
+    {
+        LOCK(cs);
+        if (setUnspent.count(vin.prevout)) {
+            fSpent = false;
+            return true;
+        }
+    }
+
+    // Not known to be unspent, check it against the chain and the mempool
+    CValidationState state;
+    CMutableTransaction tx = CMutableTransaction();
+    CTxOut vout = CTxOut(4999.99 * COIN, obfuScationPool.collateralPubKey);
+    tx.vin.push_back(vin);
+    tx.vout.push_back(vout);
+
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) return false;
+
+    // Transactions only get added or connected under cs_main, so no spend can be missed from here on
+    fSpent = !AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
+
+    if (!fSpent) {
+        LOCK(cs);
+        setUnspent.insert(vin.prevout);
+    }
+    return true;
+}
+
+void CMasternodeCollateralTracker::SyncTransaction(const CTransaction& tx) {
+    LOCK(cs);
+    if (setUnspent.empty()) return;
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        setUnspent.erase(txin.prevout);
+}
+
+void CMasternodeCollateralTracker::Forget(const CTxIn& vin) {
+    LOCK(cs);
+    setUnspent.erase(vin.prevout);
+}
+
+void CMasternodeCollateralTracker::Clear() {
+    LOCK(cs);
+    setUnspent.clear();
+}
+
 void CMasternode::Check(bool forceCheck) {
     if (ShutdownRequested()) return;
 
@@ -202,20 +250,12 @@ void CMasternode::Check(bool forceCheck) {
     }
 
     if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut(4999.99 * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
-
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = MASTERNODE_VIN_SPENT;
-                return;
-            }
+        bool fSpent = false;
+        if (!mnCollateralTracker.GetSpent(vin, fSpent)) return;
+
+        if (fSpent) {
+            activeState = MASTERNODE_VIN_SPENT;
+            return;
         }
     }
 
@@ -572,32 +612,32 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS) {
             state.IsInvalid(nDoS);
             return false;
         }
-    }
 
-    LogPrint("masternode", "mnb - Accepted Masternode entry\n");
+        LogPrint("masternode", "mnb - Accepted Masternode entry\n");
 
-    if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
-        LogPrint("masternode","mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
-        // maybe we miss few blocks, let this mnb to be checked again later
-        mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
-        masternodeSync.mapSeenSyncMNB.erase(GetHash());
-        return false;
-    }
-
-    // verify that sig time is legit in past
-    // should be at least not earlier than block when 1000 IDC tx got MASTERNODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 IDChain tx -> 1 confirmation
-        CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-        if (pConfIndex->GetBlockTime() > sigTime) {
-            LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
-                     sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+        if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
+            LogPrint("masternode","mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
+            // maybe we miss few blocks, let this mnb to be checked again later
+            mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
+            masternodeSync.mapSeenSyncMNB.erase(GetHash());
             return false;
         }
+
+        // verify that sig time is legit in past
+        // should be at least not earlier than block when 1000 IDC tx got MASTERNODE_MIN_CONFIRMATIONS
+        uint256 hashBlock = 0;
+        CTransaction tx2;
+        GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end() && (*mi).second) {
+            CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 IDChain tx -> 1 confirmation
+            CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+            if (pConfIndex->GetBlockTime() > sigTime) {
+                LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
+                         sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+                return false;
+            }
+        }
     }
 
     LogPrint("masternode","mnb - Got NEW Masternode entry - %s - %lli \n", vin.prevout.hash.ToString(), sigTime);
@@ -713,21 +753,30 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled) {
                 return false;
             }
 
-            BlockMap::iterator mi = mapBlockIndex.find(blockHash);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                if ((*mi).second->nHeight < chainActive.Height() - 24) {
-                    LogPrint("masternode","CMasternodePing::CheckAndUpdate - Masternode %s block hash %s is too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
-                    // Do nothing here (no Masternode update, no mnping relay)
-                    // Let this node to be visible but fail to accept mnping
-
+            {
+                TRY_LOCK(cs_main, lockMain);
+                if (!lockMain) {
+                    // not mnp fault, let it to be checked again later
+                    mnodeman.mapSeenMasternodePing.erase(GetHash());
                     return false;
                 }
-            } else {
-                LogPrint("masternode","CMasternodePing::CheckAndUpdate - Masternode %s block hash %s is unknown\n", vin.prevout.hash.ToString(), blockHash.ToString());
-                // maybe we stuck so we shouldn't ban this node, just fail to accept it
-                // TODO: or should we also request this block?
 
-                return false;
+                BlockMap::iterator mi = mapBlockIndex.find(blockHash);
+                if (mi != mapBlockIndex.end() && (*mi).second) {
+                    if ((*mi).second->nHeight < chainActive.Height() - 24) {
+                        LogPrint("masternode","CMasternodePing::CheckAndUpdate - Masternode %s block hash %s is too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
+                        // Do nothing here (no Masternode update, no mnping relay)
+                        // Let this node to be visible but fail to accept mnping
+
+                        return false;
+                    }
+                } else {
+                    LogPrint("masternode","CMasternodePing::CheckAndUpdate - Masternode %s block hash %s is unknown\n", vin.prevout.hash.ToString(), blockHash.ToString());
+                    // maybe we stuck so we shouldn't ban this node, just fail to accept it
+                    // TODO: or should we also request this block?
+
+                    return false;
+                }
             }
 
             pmn->lastPing = *this;
@@ -27,7 +27,9 @@ using namespace std;
 class CMasternode;
 class CMasternodeBroadcast;
 class CMasternodePing;
+class CMasternodeCollateralTracker;
 extern map<int64_t, uint256> mapCacheBlockHashes;
+extern CMasternodeCollateralTracker mnCollateralTracker;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
@@ -92,6 +94,32 @@ class CMasternodePing {
     }
 };
 
+//
+// Unspent Masternode collateral inputs, so CMasternode::Check doesn't have to run them through
+// AcceptableInputs under cs_main every time. Only inputs found unspent are kept, until a transaction
+// that enters the mempool or gets connected spends them. Anything else, including inputs that are
+// just unknown while the node is syncing, is checked again on every call.
+//
+class CMasternodeCollateralTracker {
+  private:
+    CCriticalSection cs;
+    // collateral inputs unspent in the chain and the mempool
+    std::set<COutPoint> setUnspent;
+
+  public:
+    /// Set fSpent for the collateral, returns false if its state could not be determined yet
+    bool GetSpent(const CTxIn& vin, bool& fSpent);
+
+    /// Drop the collaterals spent by a transaction added to the mempool or connected in a block
+    void SyncTransaction(const CTransaction& tx);
+
+    /// Drop the collateral of a Masternode removed from the list
+    void Forget(const CTxIn& vin);
+
+    /// Forget all states after a block was disconnected, they are checked again on their next use
+    void Clear();
+};
+
 //
 // The Masternode Class. For managing the Obfuscation process. It contains the input of the 20000 IDC, signature to prove
 // it's the one who own that ip address and code for calculating the payment election.
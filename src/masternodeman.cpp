@@ -186,6 +186,7 @@ void DumpMasternodes() {
 
 CMasternodeMan::CMasternodeMan() {
     nDsqCount = 0;
+    nListVersion = 0;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn) {
@@ -198,6 +199,7 @@ bool CMasternodeMan::Add(CMasternode& mn) {
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        nListVersion++;
         return true;
     }
 
@@ -264,7 +266,9 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval) {
                 }
             }
 
+            mnCollateralTracker.Forget((*it).vin);
             it = vMasternodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -325,6 +329,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval) {
 void CMasternodeMan::Clear() {
     LOCK(cs);
     vMasternodes.clear();
+    mnCollateralTracker.Clear();
+    nListVersion++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -566,14 +572,23 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive) {
+const CMasternodeRankTable* CMasternodeMan::GetRankTable(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, bool fMinimumAge) {
+    //make sure we know about this block
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
+
+    // Masternode states only change on Check() every MASTERNODE_CHECK_SECONDS, so a table is
+    // reused for that long as long as the list and the block at that height stay the same
+    const RankTableKey key(nBlockHeight, minProtocol, fOnlyActive, fMinimumAge);
+    std::map<RankTableKey, CMasternodeRankTable>::iterator it = mapRankTables.find(key);
+    if (it != mapRankTables.end() && it->second.hashBlock == hash && it->second.nListVersion == nListVersion &&
+        GetTime() - it->second.nTimeCreated < MASTERNODE_CHECK_SECONDS)
+        return &it->second;
+
     std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = GetSporkValue(SPORK_16_MN_WINNER_MINIMUM_AGE);
     int64_t nMasternode_Age = 0;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    bool fCheckAge = fMinimumAge && IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
 
     // scan for winner
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
@@ -582,7 +597,7 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             continue;                                                       // Skip obsolete versions
         }
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+        if (fCheckAge) {
             nMasternode_Age = GetAdjustedTime() - mn.sigTime;
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 if (fDebug) {
@@ -603,12 +618,42 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
-    int rank = 0;
+    CMasternodeRankTable* pTable;
+    if (it != mapRankTables.end()) {
+        pTable = &it->second;
+    } else if (mapRankTables.size() >= MASTERNODES_MAX_RANK_TABLES && nBlockHeight < boost::get<0>(mapRankTables.begin()->first)) {
+        // older than every cached table, caching it would evict a more recent one
+        pTable = &rankTableUncached;
+    } else {
+        // keep the tables of the most recent heights only
+        if (mapRankTables.size() >= MASTERNODES_MAX_RANK_TABLES)
+            mapRankTables.erase(mapRankTables.begin());
+        pTable = &mapRankTables.insert(make_pair(key, CMasternodeRankTable())).first->second;
+    }
+
+    CMasternodeRankTable& table = *pTable;
+    table.hashBlock = hash;
+    table.nTimeCreated = GetTime();
+    table.nListVersion = nListVersion;
+    table.vRanked.clear();
+    table.mapRanks.clear();
     BOOST_FOREACH(PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
-        }
+        table.vRanked.push_back(s.second);
+        table.mapRanks.insert(make_pair(s.second.prevout, (int)table.vRanked.size()));
+    }
+
+    return &table;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive) {
+    LOCK(cs);
+
+    const CMasternodeRankTable* pTable = GetRankTable(nBlockHeight, minProtocol, fOnlyActive, true);
+    if (pTable == NULL) return -1;
+
+    std::map<COutPoint, int>::const_iterator it = pTable->mapRanks.find(vin.prevout);
+    if (it != pTable->mapRanks.end()) {
+        return it->second;
     }
 
     return -1;
@@ -651,33 +696,12 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 }
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive) {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
+    LOCK(cs);
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    const CMasternodeRankTable* pTable = GetRankTable(nBlockHeight, minProtocol, fOnlyActive, false);
+    if (pTable == NULL || nRank < 1 || nRank > (int)pTable->vRanked.size()) return NULL;
 
-    int rank = 0;
-    BOOST_FOREACH(PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
-
-    return NULL;
+    return Find(pTable->vRanked[nRank - 1]);
 }
 
 void CMasternodeMan::ProcessMasternodeConnections() {
@@ -963,14 +987,11 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         tx.vin.push_back(vin);
         tx.vout.push_back(vout);
 
-        bool fAcceptable = false;
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
-            fAcceptable = AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
-        }
+        // also covers the coins and block index lookups below, "dsee" is handled off the main message thread
+        TRY_LOCK(cs_main, lockMain);
+        if (!lockMain) return;
 
-        if (fAcceptable) {
+        if (AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
             if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
                 LogPrint("masternode","dsee - Input must have least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
                 Misbehaving(pfrom->GetId(), 20);
@@ -1113,7 +1134,9 @@ void CMasternodeMan::Remove(CTxIn vin) {
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            mnCollateralTracker.Forget((*it).vin);
             vMasternodes.erase(it);
+            nListVersion++;
             break;
         }
         ++it;
@@ -1134,6 +1157,7 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb) {
             masternodeSync.AddedMasternodeList(mnb.GetHash());
         }
     } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        nListVersion++;
         masternodeSync.AddedMasternodeList(mnb.GetHash());
     }
 }
@@ -14,8 +14,12 @@
 #include "sync.h"
 #include "util.h"
 
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_MAX_RANK_TABLES 64
 
 using namespace std;
 
@@ -47,6 +51,18 @@ class CMasternodeDB {
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Masternodes of the list ordered by their score for one block, see CMasternodeMan::GetRankTable
+ */
+class CMasternodeRankTable {
+  public:
+    uint256 hashBlock;
+    int64_t nTimeCreated;
+    unsigned int nListVersion;
+    // vin of the masternode ranked i + 1
+    std::vector<CTxIn> vRanked;
+    std::map<COutPoint, int> mapRanks;
+};
+
 class CMasternodeMan {
   private:
     // critical section to protect the inner data structures
@@ -64,6 +80,17 @@ class CMasternodeMan {
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // changed whenever Masternodes are added, removed or updated, invalidates the rank tables
+    unsigned int nListVersion;
+    // rank tables by height, minimum protocol, only active and minimum age filters
+    typedef boost::tuple<int64_t, int, bool, bool> RankTableKey;
+    std::map<RankTableKey, CMasternodeRankTable> mapRankTables;
+    // table for a height below all cached ones, valid until the next GetRankTable() call
+    CMasternodeRankTable rankTableUncached;
+
+    /// Masternodes ranked by score for a block, computed once and reused until the list or the block at that height changes
+    const CMasternodeRankTable* GetRankTable(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, bool fMinimumAge);
+
   public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
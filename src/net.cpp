@@ -27,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -34,6 +38,8 @@
 #include <miniupnpc/upnperrors.h>
 #endif
 
+#include <atomic>
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -741,10 +747,287 @@ void SocketSendData(CNode* pnode) {
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
+namespace {
+/**
+ * Readiness of the sockets serviced by ThreadSocketHandler.
+ *
+ * Every round the handler declares which sockets it wants to receive from or send to.
+ * With epoll the sockets stay registered between rounds, so only a change of interest
+ * costs a system call, a wakeup only reports the sockets that are ready and there is
+ * no FD_SETSIZE limit on the number of peers. Where epoll is not available select()
+ * is used as before.
+ */
+class CSocketEvents {
+    //! Interest in one socket for the current round
+    struct CInterest {
+        SOCKET hSocket;
+        NodeId id;
+        bool fRecv;
+        bool fSend;
+    };
+    std::vector<CInterest> vInterest;
+    bool fAllReady;
+
+#ifdef HAVE_SYS_EPOLL_H
+    int hEpoll;
+    //! Self-pipe that wakes epoll_wait when data is queued for sending
+    int pipeWake[2];
+    std::atomic<bool> fWakePending;
+    //! Events registered with the kernel, by socket and owning node (-1 for listen sockets)
+    std::map<std::pair<SOCKET, NodeId>, uint32_t> mapRegistered;
+    std::map<SOCKET, uint32_t> mapReady;
+#endif
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+
+    bool WaitSelect(int nTimeoutMs);
+#ifdef HAVE_SYS_EPOLL_H
+    bool WaitEpoll(int nTimeoutMs);
+#endif
+
+public:
+    CSocketEvents();
+    ~CSocketEvents();
+
+    /** Set up the epoll backend, falls back to select() when that fails */
+    void Init();
+    /** Declare interest in a socket for the next Wait(), interest is reset after each Wait() */
+    void Want(SOCKET hSocket, NodeId id, bool fRecv, bool fSend);
+    /** Wait up to nTimeoutMs for any of the sockets to become ready */
+    void Wait(int nTimeoutMs);
+    /** Whether hSocket can be read from, errors count as readable so they are picked up by recv() */
+    bool IsRecv(SOCKET hSocket) const;
+    bool IsSend(SOCKET hSocket) const;
+    /** Interrupt a running Wait() (epoll only, select() picks up new data within its timeout) */
+    void Wake();
+};
+
+CSocketEvents::CSocketEvents() : fAllReady(false) {
+#ifdef HAVE_SYS_EPOLL_H
+    hEpoll = -1;
+    pipeWake[0] = pipeWake[1] = -1;
+    fWakePending = false;
+#endif
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+}
+
+CSocketEvents::~CSocketEvents() {
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1)
+        close(hEpoll);
+    if (pipeWake[0] != -1) {
+        close(pipeWake[0]);
+        close(pipeWake[1]);
+    }
+#endif
+}
+
+void CSocketEvents::Init() {
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1)
+        return;
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1) {
+        LogPrintf("epoll_create1 failed (%s), using select()\n", NetworkErrorString(errno));
+        return;
+    }
+    if (pipe(pipeWake) != 0) {
+        pipeWake[0] = pipeWake[1] = -1;
+    } else {
+        fcntl(pipeWake[0], F_SETFL, O_NONBLOCK);
+        fcntl(pipeWake[1], F_SETFL, O_NONBLOCK);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = pipeWake[0];
+        epoll_ctl(hEpoll, EPOLL_CTL_ADD, pipeWake[0], &event);
+    }
+#endif
+}
+
+void CSocketEvents::Want(SOCKET hSocket, NodeId id, bool fRecv, bool fSend) {
+    CInterest interest = {hSocket, id, fRecv, fSend};
+    vInterest.push_back(interest);
+}
+
+void CSocketEvents::Wait(int nTimeoutMs) {
+    fAllReady = false;
+#ifdef HAVE_SYS_EPOLL_H
+    mapReady.clear();
+    if (hEpoll != -1) {
+        if (!WaitEpoll(nTimeoutMs))
+            fAllReady = true;
+        vInterest.clear();
+        return;
+    }
+#endif
+    if (!WaitSelect(nTimeoutMs))
+        fAllReady = true;
+    vInterest.clear();
+}
+
+bool CSocketEvents::WaitSelect(int nTimeoutMs) {
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = nTimeoutMs * 1000;
+
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const CInterest& interest, vInterest) {
+#ifndef WIN32
+        // only reachable when epoll failed at runtime
+        if (interest.hSocket >= FD_SETSIZE)
+            continue;
+#endif
+        // only nodes are checked for errors, listen sockets just for incoming connections
+        if (interest.id != -1)
+            FD_SET(interest.hSocket, &fdsetError);
+        if (interest.fRecv)
+            FD_SET(interest.hSocket, &fdsetRecv);
+        if (interest.fSend)
+            FD_SET(interest.hSocket, &fdsetSend);
+        hSocketMax = max(hSocketMax, interest.hSocket);
+        have_fds = true;
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+        }
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(nTimeoutMs);
+        // try to receive from every socket, whatever is broken gets disconnected by recv()
+        return !have_fds;
+    }
+    return true;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+bool CSocketEvents::WaitEpoll(int nTimeoutMs) {
+    std::map<std::pair<SOCKET, NodeId>, uint32_t> mapWanted;
+    BOOST_FOREACH(const CInterest& interest, vInterest) {
+        uint32_t nEvents = (interest.fRecv ? (uint32_t)EPOLLIN : 0) | (interest.fSend ? (uint32_t)EPOLLOUT : 0);
+        // Sockets without interest are left out, a hung up peer would otherwise wake every round
+        if (nEvents != 0)
+            mapWanted[std::make_pair(interest.hSocket, interest.id)] = nEvents;
+    }
+
+    // Remove stale registrations first, the socket number may already be reused by a new peer
+    std::map<std::pair<SOCKET, NodeId>, uint32_t>::iterator mi = mapRegistered.begin();
+    while (mi != mapRegistered.end()) {
+        if (!mapWanted.count(mi->first)) {
+            // fails harmlessly for sockets that were closed, which removes them from epoll
+            epoll_ctl(hEpoll, EPOLL_CTL_DEL, mi->first.first, NULL);
+            mapRegistered.erase(mi++);
+        } else
+            mi++;
+    }
+    for (mi = mapWanted.begin(); mi != mapWanted.end(); mi++) {
+        std::map<std::pair<SOCKET, NodeId>, uint32_t>::iterator ri = mapRegistered.find(mi->first);
+        if (ri != mapRegistered.end() && ri->second == mi->second)
+            continue;
+        struct epoll_event event;
+        event.events = mi->second;
+        event.data.fd = mi->first.first;
+        int nOp = ri == mapRegistered.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        if (epoll_ctl(hEpoll, nOp, mi->first.first, &event) != 0) {
+            LogPrintf("epoll_ctl failed for socket %d: %s\n", mi->first.first, NetworkErrorString(errno));
+            if (ri != mapRegistered.end())
+                mapRegistered.erase(ri);
+            continue;
+        }
+        mapRegistered[mi->first] = mi->second;
+    }
+
+    std::vector<struct epoll_event> vEvents(std::max<size_t>(mapRegistered.size() + 1, 16));
+    int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), nTimeoutMs);
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(nTimeoutMs);
+            return false;
+        }
+        return true;
+    }
+    for (int i = 0; i < nEvents; i++) {
+        if (vEvents[i].data.fd == pipeWake[0]) {
+            // drain before clearing the flag, a wakeup may get lost (costing one timeout) but never gets stuck
+            char buf[64];
+            while (read(pipeWake[0], buf, sizeof(buf)) > 0) {}
+            fWakePending = false;
+            continue;
+        }
+        mapReady[vEvents[i].data.fd] |= vEvents[i].events;
+    }
+    return true;
+}
+#endif
+
+bool CSocketEvents::IsRecv(SOCKET hSocket) const {
+    if (fAllReady)
+        return true;
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1) {
+        std::map<SOCKET, uint32_t>::const_iterator mi = mapReady.find(hSocket);
+        return mi != mapReady.end() && (mi->second & (EPOLLIN | EPOLLERR | EPOLLHUP));
+    }
+#endif
+#ifndef WIN32
+    if (hSocket >= FD_SETSIZE)
+        return false;
+#endif
+    return FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError);
+}
+
+bool CSocketEvents::IsSend(SOCKET hSocket) const {
+    if (fAllReady)
+        return false;
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1) {
+        std::map<SOCKET, uint32_t>::const_iterator mi = mapReady.find(hSocket);
+        return mi != mapReady.end() && (mi->second & EPOLLOUT);
+    }
+#endif
+#ifndef WIN32
+    if (hSocket >= FD_SETSIZE)
+        return false;
+#endif
+    return FD_ISSET(hSocket, &fdsetSend);
+}
+
+void CSocketEvents::Wake() {
+#ifdef HAVE_SYS_EPOLL_H
+    if (pipeWake[1] == -1 || fWakePending.exchange(true))
+        return;
+    char c = 0;
+    if (write(pipeWake[1], &c, 1) != 1)
+        fWakePending = false;
+#endif
+}
+
+CSocketEvents socketEvents;
+} // anon namespace
+
+void WakeSocketHandler() {
+    socketEvents.Wake();
+}
+
 static list<CNode*> vNodesDisconnected;
 
 void ThreadSocketHandler() {
     unsigned int nPrevNodeCount = 0;
+    socketEvents.Init();
     while (true) {
         //
         // Disconnect nodes
@@ -810,23 +1093,8 @@ void ThreadSocketHandler() {
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            socketEvents.Want(hListenSocket.socket, -1, true, false);
         }
 
         {
@@ -834,18 +1102,15 @@ void ThreadSocketHandler() {
             BOOST_FOREACH(CNode* pnode, vNodes) {
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
 
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
                 // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
+                //   or there is space left in the buffer, wait for receiving data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
                 // Together, that means that at least one of the following is always possible,
@@ -853,43 +1118,29 @@ void ThreadSocketHandler() {
                 // * We send some data.
                 // * We wait for data to be received (and disconnect after timeout).
                 // * We process a message in the buffer (message handler thread).
+                bool fSend = false;
+                bool fRecv = false;
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    fSend = lockSend && !pnode->vSendMsg.empty();
                 }
-                {
+                if (!fSend) {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                     pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                    fRecv = lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                         pnode->GetTotalRecvSize() <= ReceiveFloodSize());
                 }
+                socketEvents.Want(pnode->hSocket, pnode->GetId(), fRecv, fSend);
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        socketEvents.Wait(50); // frequency to poll pnode->vSend
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && socketEvents.IsRecv(hListenSocket.socket)) {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -954,7 +1205,7 @@ void ThreadSocketHandler() {
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (socketEvents.IsRecv(pnode->hSocket)) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
@@ -990,7 +1241,7 @@ void ThreadSocketHandler() {
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (socketEvents.IsSend(pnode->hSocket)) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     SocketSendData(pnode);
@@ -1456,7 +1707,7 @@ void ThreadMessageHandler() {
                         pnode->CloseSocketDisconnect();
 
                     if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
+                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete() && !pnode->fRecvQueueFull)) {
                             fSleep = false;
                         }
                     }
@@ -1976,6 +2227,8 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nServices = 0;
     hSocket = hSocketIn;
     nRecvVersion = INIT_PROTO_VERSION;
+    nRecvQueuedSize = 0;
+    fRecvQueueFull = false;
     nLastSend = 0;
     nLastRecv = 0;
     nSendBytes = 0;
@@ -2110,8 +2363,12 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend) {
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (it == vSendMsg.begin()) {
         SocketSendData(this);
+        // Whatever didn't fit in the socket buffer is picked up by the socket handler
+        if (!vSendMsg.empty())
+            WakeSocketHandler();
+    }
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
@@ -21,6 +21,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -79,6 +80,8 @@ bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup);
 bool StopNode();
 void SocketSendData(CNode* pnode);
+/** Wake the socket handler, e.g. when data was queued that the optimistic write couldn't send */
+void WakeSocketHandler();
 
 typedef int NodeId;
 
@@ -141,6 +144,8 @@ extern CCriticalSection cs_vAddedNodes;
 extern NodeId nLastNodeId;
 extern CCriticalSection cs_nLastNodeId;
 
+extern boost::condition_variable messageHandlerCondition;
+
 struct LocalServiceInfo {
     int nScore;
     int nPort;
@@ -225,6 +230,10 @@ class CNode {
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
+    //! Bytes of received messages handed to another thread and not yet processed
+    std::atomic<unsigned int> nRecvQueuedSize;
+    //! The next received message waits for nRecvQueuedSize to go down
+    std::atomic<bool> fRecvQueueFull;
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -331,7 +340,7 @@ class CNode {
 
     // requires LOCK(cs_vRecvMsg)
     unsigned int GetTotalRecvSize() {
-        unsigned int total = 0;
+        unsigned int total = nRecvQueuedSize;
         BOOST_FOREACH(const CNetMessage& msg, vRecvMsg) {
             total += msg.vRecv.size() + 24;
         }
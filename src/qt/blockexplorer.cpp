@@ -27,13 +27,15 @@ static std::string makeHRef(const std::string& Str) {
     return "<a href=\"" + Str + "\">" + Str + "</a>";
 }
 
-static CAmount getTxIn(const CTransaction& tx) {
+// pSpentOutputs are the outputs spent by tx as read from the block undo data, if it covers every input
+static CAmount getTxIn(const CTransaction& tx, const std::vector<CTxOut>* pSpentOutputs = NULL) {
     if (tx.IsCoinBase())
         return 0;
 
+    bool fSpentOutputs = pSpentOutputs && pSpentOutputs->size() == tx.vin.size();
     CAmount Sum = 0;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
-        Sum += getPrevOut(tx.vin[i].prevout).nValue;
+        Sum += fSpentOutputs ? (*pSpentOutputs)[i].nValue : getPrevOut(tx.vin[i].prevout).nValue;
     return Sum;
 }
 
@@ -150,6 +152,26 @@ CTxOut getPrevOut(const COutPoint& out) {
     return CTxOut();
 }
 
+// Outputs spent by tx, read from the undo data of the block that contains it
+static void getSpentOutputs(const uint256& BlockHash, const CTransaction& tx, std::vector<CTxOut>& vSpentOutputs) {
+    BlockMap::iterator mi = mapBlockIndex.find(BlockHash);
+    if (mi == mapBlockIndex.end() || !mi->second)
+        return;
+
+    CBlock block;
+    std::vector<std::vector<CTxOut> > vBlockSpentOutputs;
+    if (!ReadBlockFromDisk(block, mi->second) || !ReadBlockSpentOutputs(block, mi->second, vBlockSpentOutputs))
+        return;
+
+    const uint256 TxHash = tx.GetHash();
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        if (block.vtx[i].GetHash() == TxHash) {
+            vSpentOutputs.swap(vBlockSpentOutputs[i]);
+            return;
+        }
+    }
+}
+
 void getNextIn(const COutPoint& Out, uint256& Hash, unsigned int& n) {
     // Hash = 0;
     // n = 0;
@@ -184,6 +206,9 @@ std::string BlockToString(CBlockIndex* pBlock) {
     CBlock block;
     ReadBlockFromDisk(block, pBlock);
 
+    std::vector<std::vector<CTxOut> > vSpentOutputs;
+    ReadBlockSpentOutputs(block, pBlock, vSpentOutputs);
+
     CAmount Fees = 0;
     CAmount OutVolume = 0;
     CAmount Reward = 0;
@@ -195,7 +220,7 @@ std::string BlockToString(CBlockIndex* pBlock) {
         const CTransaction& tx = block.vtx[i];
         TxContent += TxToRow(tx);
 
-        CAmount In = getTxIn(tx);
+        CAmount In = getTxIn(tx, i < vSpentOutputs.size() ? &vSpentOutputs[i] : NULL);
         CAmount Out = tx.GetValueOut();
         if (tx.IsCoinBase())
             Reward += Out;
@@ -288,10 +313,12 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx) {
             ValueToString(Output)
         };
         InputsContent += makeHTMLTableRow(InputsContentCells, sizeof(InputsContentCells) / sizeof(std::string));
-    } else
+    } else {
+        std::vector<CTxOut> vSpentOutputs;
+        getSpentOutputs(BlockHash, tx, vSpentOutputs);
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             COutPoint Out = tx.vin[i].prevout;
-            CTxOut PrevOut = getPrevOut(tx.vin[i].prevout);
+            CTxOut PrevOut = vSpentOutputs.size() == tx.vin.size() ? vSpentOutputs[i] : getPrevOut(tx.vin[i].prevout);
             if (PrevOut.nValue < 0)
                 Input = -Params().MaxMoneyOut();
             else
@@ -304,6 +331,7 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx) {
             };
             InputsContent += makeHTMLTableRow(InputsContentCells, sizeof(InputsContentCells) / sizeof(std::string));
         }
+    }
 
     uint256 TxHash = tx.GetHash();
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
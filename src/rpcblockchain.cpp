@@ -657,18 +657,29 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp) {
         if (!ReadBlockFromDisk(block, pindex))
             throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
 
+        // spent outputs come from the undo data, inputs it does not cover are looked up one by one
+        std::vector<std::vector<CTxOut> > vSpentOutputs;
+        ReadBlockSpentOutputs(block, pindex, vSpentOutputs);
+
         CAmount nValueIn = 0;
         CAmount nValueOut = 0;
-        for (const CTransaction& tx : block.vtx) {
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
             if (tx.IsCoinBase() || tx.IsCoinStake())
                 continue;
 
+            const bool fSpentOutputs = i < vSpentOutputs.size() && vSpentOutputs[i].size() == tx.vin.size();
             for (unsigned int j = 0; j < tx.vin.size(); j++) {
                 if (tx.vin[j].scriptSig.IsZerocoinSpend()) {
                     nValueIn += tx.vin[j].nSequence * COIN;
                     continue;
                 }
 
+                if (fSpentOutputs) {
+                    nValueIn += vSpentOutputs[i][j].nValue;
+                    continue;
+                }
+
                 COutPoint prevout = tx.vin[j].prevout;
                 CTransaction txPrev;
                 uint256 hashBlock;
@@ -132,7 +132,10 @@ UniValue importprivkey(const UniValue& params, bool fHelp) {
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
         if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+            bool fAborted = false;
+            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true, &fAborted);
+            if (fAborted)
+                throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by shutdown");
         }
     }
 
@@ -194,7 +197,10 @@ UniValue importaddress(const UniValue& params, bool fHelp) {
             throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
 
         if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+            bool fAborted = false;
+            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true, &fAborted);
+            if (fAborted)
+                throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by shutdown");
             pwalletMain->ReacceptWalletTransactions();
         }
     }
@@ -288,9 +294,13 @@ UniValue importwallet(const UniValue& params, bool fHelp) {
         pwalletMain->nTimeFirstKey = nTimeBegin;
 
     LogPrintf("Rescanning last %i blocks\n", chainActive.Height() - pindex->nHeight + 1);
-    pwalletMain->ScanForWalletTransactions(pindex);
+    bool fAborted = false;
+    pwalletMain->ScanForWalletTransactions(pindex, false, &fAborted);
     pwalletMain->MarkDirty();
 
+    if (fAborted)
+        throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by shutdown");
+
     if (!fGood)
         throw JSONRPCError(RPC_WALLET_ERROR, "Error adding some keys to wallet");
 
@@ -473,7 +483,10 @@ UniValue bip38decrypt(const UniValue& params, bool fHelp) {
 
         // whenever a key is imported, we need to scan the whole chain
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
-        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+        bool fAborted = false;
+        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true, &fAborted);
+        if (fAborted)
+            throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by shutdown");
     }
 
     return result;
@@ -516,6 +516,9 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp) {
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"stakethreads\": n,                (numeric) threads used by the last stake search\n"
+            "  \"stakesearchcoins\": n,            (numeric) coins checked by the last stake search\n"
+            "  \"coinspersecond\": n,              (numeric) coins checked per second by the last stake search\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -537,6 +540,13 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp) {
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    if (pwalletMain) {
+        LOCK(pwalletMain->cs_wallet);
+        obj.push_back(Pair("stakethreads", pwalletMain->nStakeSearchThreads));
+        obj.push_back(Pair("stakesearchcoins", pwalletMain->nStakeSearchCoins));
+        obj.push_back(Pair("coinspersecond", pwalletMain->nStakeSearchMicros > 0 ? pwalletMain->nStakeSearchCoins * 1000000.0 / pwalletMain->nStakeSearchMicros : 0.0));
+    }
+
     return obj;
 }
 #endif // ENABLE_WALLET
@@ -2296,8 +2296,7 @@ UniValue listmintedzerocoins(const UniValue& params, bool fHelp) {
     if (pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listPubCoin = walletdb.ListMintedCoins(true, false, true);
+    list<CZerocoinMint> listPubCoin = pwalletMain->ListMintedCoins(true, false, true);
 
     UniValue jsonList(UniValue::VARR);
     for (const CZerocoinMint& pubCoinItem : listPubCoin) {
@@ -2317,8 +2316,7 @@ UniValue listzerocoinamounts(const UniValue& params, bool fHelp) {
     if (pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listPubCoin = walletdb.ListMintedCoins(true, true, true);
+    list<CZerocoinMint> listPubCoin = pwalletMain->ListMintedCoins(true, true, true);
 
     std::map<libzerocoin::CoinDenomination, CAmount> spread;
     for (const auto& denom : libzerocoin::zerocoinDenomList)
@@ -2511,8 +2509,7 @@ UniValue resetmintzerocoin(const UniValue& params, bool fHelp) {
     if (params.size() == 1)
         fExtendedSearch = params[0].get_bool();
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, true);
+    list<CZerocoinMint> listMints = pwalletMain->ListMintedCoins(false, false, true);
     vector<CZerocoinMint> vMintsToFind{ std::make_move_iterator(std::begin(listMints)), std::make_move_iterator(std::end(listMints)) };
     vector<CZerocoinMint> vMintsMissing;
     vector<CZerocoinMint> vMintsToUpdate;
@@ -2520,10 +2517,12 @@ UniValue resetmintzerocoin(const UniValue& params, bool fHelp) {
     // search all of our available data for these mints
     FindMints(vMintsToFind, vMintsToUpdate, vMintsMissing, fExtendedSearch);
 
+    LOCK(pwalletMain->cs_wallet);
+
     // update the meta data of mints that were marked for updating
     UniValue arrUpdated(UniValue::VARR);
     for (CZerocoinMint mint : vMintsToUpdate) {
-        walletdb.WriteZerocoinMint(mint);
+        pwalletMain->WriteZerocoinMint(mint);
         arrUpdated.push_back(mint.GetValue().GetHex());
     }
 
@@ -2531,7 +2530,7 @@ UniValue resetmintzerocoin(const UniValue& params, bool fHelp) {
     UniValue arrDeleted(UniValue::VARR);
     for (CZerocoinMint mint : vMintsMissing) {
         arrDeleted.push_back(mint.GetValue().GetHex());
-        walletdb.ArchiveMintOrphan(mint);
+        pwalletMain->ArchiveMintOrphan(mint);
     }
 
     UniValue obj(UniValue::VOBJ);
@@ -2548,7 +2547,7 @@ UniValue resetspentzerocoin(const UniValue& params, bool fHelp) {
             + HelpRequiringPassphrase());
 
     CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, false);
+    list<CZerocoinMint> listMints = pwalletMain->ListMintedCoins(false, false, false);
     list<CZerocoinSpend> listSpends = walletdb.ListSpentCoins();
     list<CZerocoinSpend> listUnconfirmedSpends;
 
@@ -2571,7 +2570,7 @@ UniValue resetspentzerocoin(const UniValue& params, bool fHelp) {
         for (CZerocoinMint mint : listMints) {
             if (mint.GetSerialNumber() == spend.GetSerial()) {
                 mint.SetUsed(false);
-                walletdb.WriteZerocoinMint(mint);
+                pwalletMain->WriteZerocoinMint(mint);
                 walletdb.EraseZerocoinSpendSerialEntry(spend.GetSerial());
                 RemoveSerialFromDB(spend.GetSerial());
                 UniValue obj(UniValue::VOBJ);
@@ -2641,13 +2640,12 @@ UniValue exportzerocoins(const UniValue& params, bool fHelp) {
     if (pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
 
     bool fIncludeSpent = params[0].get_bool();
     libzerocoin::CoinDenomination denomination = libzerocoin::ZQ_ERROR;
     if (params.size() == 2)
         denomination = libzerocoin::IntToZerocoinDenomination(params[1].get_int());
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(!fIncludeSpent, false, false);
+    list<CZerocoinMint> listMints = pwalletMain->ListMintedCoins(!fIncludeSpent, false, false);
 
     UniValue jsonList(UniValue::VARR);
     for (const CZerocoinMint mint : listMints) {
@@ -2693,7 +2691,6 @@ UniValue importzerocoins(const UniValue& params, bool fHelp) {
 
     RPCTypeCheck(params, list_of(UniValue::VARR)(UniValue::VOBJ));
     UniValue arrMints = params[0].get_array();
-    CWalletDB walletdb(pwalletMain->strWalletFile);
 
     int count = 0;
     CAmount nValue = 0;
@@ -2722,7 +2719,10 @@ UniValue importzerocoins(const UniValue& params, bool fHelp) {
         CZerocoinMint mint(denom, bnValue, bnRandom, bnSerial, fUsed);
         mint.SetTxHash(txid);
         mint.SetHeight(nHeight);
-        walletdb.WriteZerocoinMint(mint);
+        {
+            LOCK(pwalletMain->cs_wallet);
+            pwalletMain->WriteZerocoinMint(mint);
+        }
         count++;
         nValue += libzerocoin::ZerocoinDenominationToAmount(denom);
     }
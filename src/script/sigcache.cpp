@@ -5,13 +5,15 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <atomic>
+#include <string.h>
+#include <vector>
 
 namespace {
 
@@ -19,59 +21,133 @@ namespace {
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * Entries are salted SHA256 hashes of (signature hash, public key, signature), so
+ * every entry takes 32 bytes and an attacker can't predict where it is stored.
+ * An entry can live in one of SLOTS_PER_ENTRY places of a fixed size table, chosen
+ * by different parts of its hash. Each place is a set of atomic words, so script
+ * check threads look up and insert concurrently without taking a lock. A lookup
+ * racing with an insert at the same place may miss, which only costs a signature
+ * check; matching half-written words would require guessing a salted hash.
  */
 class CSignatureCache {
   private:
-    //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    static const unsigned int SLOTS_PER_ENTRY = 8;
+    static const unsigned int WORDS_PER_ENTRY = 4;
+
+    struct Entry {
+        std::atomic<uint64_t> words[WORDS_PER_ENTRY];
+    };
+
+    //! SHA256 state after writing the salt, padded to a full block
+    CSHA256 hasherSalted;
+    std::vector<Entry> vTable;
+    uint32_t nMask;
+    //! Picks which of the places of a new entry gets overwritten when all are taken
+    std::atomic<uint32_t> nInsertions;
+
+    void ComputeEntry(uint64_t entry[WORDS_PER_ENTRY], const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const {
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        CSHA256(hasherSalted).Write(hash.begin(), 32).Write(pubKey.begin(), pubKey.size()).Write(vchSig.empty() ? NULL : &vchSig[0], vchSig.size()).Finalize(buf);
+        memcpy(entry, buf, sizeof(buf));
+    }
+
+    uint32_t Slot(const uint64_t entry[WORDS_PER_ENTRY], unsigned int i) const {
+        // every 32 bit part of the hash selects one place
+        return (uint32_t)(entry[i / 2] >> (32 * (i % 2))) & nMask;
+    }
+
+    bool Matches(const Entry& slot, const uint64_t entry[WORDS_PER_ENTRY]) const {
+        for (unsigned int i = 0; i < WORDS_PER_ENTRY; i++) {
+            if (slot.words[i].load(std::memory_order_relaxed) != entry[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool IsEmpty(const Entry& slot) const {
+        for (unsigned int i = 0; i < WORDS_PER_ENTRY; i++) {
+            if (slot.words[i].load(std::memory_order_relaxed) != 0)
+                return false;
+        }
+        return true;
+    }
 
   public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+    /**
+     * Size of the cache from -maxsigcachemb, in entries. -maxsigcachesize, which used to limit
+     * the number of cached signatures, is still honoured as a number of entries.
+     */
+    static int64_t GetMaxEntries() {
+        if (mapArgs.count("-maxsigcachesize"))
+            return std::min<int64_t>(GetArg("-maxsigcachesize", 0), (MAX_MAX_SIG_CACHE_SIZE << 20) / sizeof(Entry));
+        return std::min<int64_t>(GetArg("-maxsigcachemb", DEFAULT_MAX_SIG_CACHE_SIZE), MAX_MAX_SIG_CACHE_SIZE) * 1024 * 1024 / sizeof(Entry);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+    /** nMaxEntries is rounded down to a power of two, 0 disables the cache */
+    explicit CSignatureCache(int64_t nMaxEntries) : nMask(0), nInsertions(0) {
+        unsigned char salt[64] = {};
+        GetRandBytes(salt, 32);
+        hasherSalted.Write(salt, sizeof(salt));
+
+        if (nMaxEntries <= 0)
+            return;
+        size_t nEntries = 1;
+        while ((int64_t)nEntries * 2 <= nMaxEntries)
+            nEntries *= 2;
+        vTable = std::vector<Entry>(nEntries);
+        nMask = nEntries - 1;
+        for (Entry& slot : vTable) {
+            for (unsigned int i = 0; i < WORDS_PER_ENTRY; i++)
+                slot.words[i].store(0, std::memory_order_relaxed);
+        }
+        LogPrintf("Using %zu MiB for a signature cache of %zu entries\n", (nEntries * sizeof(Entry)) >> 20, nEntries);
+    }
+
+    bool
+    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const {
+        if (vTable.empty())
+            return false;
+
+        uint64_t entry[WORDS_PER_ENTRY];
+        ComputeEntry(entry, hash, vchSig, pubKey);
+        for (unsigned int i = 0; i < SLOTS_PER_ENTRY; i++) {
+            if (Matches(vTable[Slot(entry, i)], entry))
+                return true;
+        }
         return false;
     }
 
     void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize) {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+        if (vTable.empty())
+            return;
+
+        uint64_t entry[WORDS_PER_ENTRY];
+        ComputeEntry(entry, hash, vchSig, pubKey);
+
+        // Take a free place if there is one, otherwise evict one of the entries in our places.
+        // The choice is spread by a counter so a set of signatures can't keep evicting each other.
+        unsigned int nSlot = nInsertions++ % SLOTS_PER_ENTRY;
+        for (unsigned int i = 0; i < SLOTS_PER_ENTRY; i++) {
+            const Entry& slot = vTable[Slot(entry, i)];
+            if (Matches(slot, entry))
+                return;
+            if (IsEmpty(slot)) {
+                nSlot = i;
+                break;
+            }
         }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+        Entry& slot = vTable[Slot(entry, nSlot)];
+        for (unsigned int i = 0; i < WORDS_PER_ENTRY; i++)
+            slot.words[i].store(entry[i], std::memory_order_relaxed);
     }
 };
 
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const {
-    static CSignatureCache signatureCache;
+    static CSignatureCache signatureCache(CSignatureCache::GetMaxEntries());
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
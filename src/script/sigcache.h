@@ -10,6 +10,11 @@
 
 #include <vector>
 
+//! -maxsigcachemb default, in MiB
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 16;
+//! Largest accepted -maxsigcachemb, in MiB
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker {
@@ -304,6 +304,52 @@ class CDataStream {
     }
 };
 
+/** Read-only stream over memory owned by someone else, such as a memory-mapped file.
+ *
+ * Deserializes straight from the underlying bytes without copying them into a buffer first.
+ * The memory must stay valid for as long as the stream is used.
+ */
+class CSpanStream {
+  private:
+    const char* pbegin;
+    const char* pend;
+    int nType;
+    int nVersion;
+
+  public:
+    CSpanStream(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) : pbegin(pbeginIn), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    //
+    // Stream subset
+    //
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+    const char* begin() const { return pbegin; }
+    const char* end() const { return pend; }
+
+    int GetType() {
+        return nType;
+    }
+    int GetVersion() {
+        return nVersion;
+    }
+
+    CSpanStream& read(char* pch, size_t nSize) {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanStream::read : end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CSpanStream& operator>>(T& obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 
 /** Non-refcounted RAII wrapper for FILE*
  *
@@ -0,0 +1,31 @@
+// Copyright (c) 2019 The IDChain developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "random.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+BOOST_AUTO_TEST_CASE(stake_kernel_hasher_test) {
+    for (int i = 0; i < 100; i++) {
+        uint64_t nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        unsigned int nTimeBlockFrom = GetRand(1 << 30);
+        unsigned int prevoutIndex = GetRand(100);
+        uint256 prevoutHash = GetRandHash();
+
+        CDataStream ss(SER_GETHASH, 0);
+        ss << nStakeModifier;
+        const CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevoutIndex, prevoutHash);
+
+        // the same hasher must serve any number of time slots
+        for (unsigned int nTimeTx = nTimeBlockFrom; nTimeTx < nTimeBlockFrom + 10; nTimeTx++)
+            BOOST_CHECK(hasher.GetHash(nTimeTx) == stakeHash(nTimeTx, ss, prevoutIndex, prevoutHash, nTimeBlockFrom));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
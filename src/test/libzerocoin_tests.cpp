@@ -23,6 +23,7 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
 #include "libzerocoin/Accumulator.h"
+#include "libzerocoin/FixedBaseExp.h"
 
 using namespace std;
 using namespace libzerocoin;
@@ -376,6 +377,39 @@ bool Test_InvalidCoin() {
     return true;
 }
 
+bool
+Test_FixedBaseExp() {
+    try {
+        const IntegerGroupParams& group = g_Params->serialNumberSoKCommitmentGroup;
+        MontgomeryContext mont(group.modulus);
+        FixedBaseExp fixedExp(group.g, mont, group.modulus.bitSize());
+
+        vector<CBigNum> vExponents;
+        vExponents.push_back(0);
+        vExponents.push_back(1);
+        vExponents.push_back(group.groupOrder - 1);
+        vExponents.push_back(CBigNum(0) - CBigNum::randBignum(group.groupOrder));
+        // larger than the precomputed table covers
+        vExponents.push_back(group.modulus * group.modulus);
+        for (uint32_t i = 0; i < 10; i++) {
+            vExponents.push_back(CBigNum::randBignum(group.modulus));
+        }
+
+        CBigNum base = group.randomElement();
+        for (const CBigNum& e : vExponents) {
+            if (fixedExp.pow_mod(e) != group.g.pow_mod(e, group.modulus))
+                return false;
+            if (mont.pow_mod(base, e) != base.pow_mod(e, group.modulus))
+                return false;
+        }
+    } catch (runtime_error &e) {
+        cout << e.what() << endl;
+        return false;
+    }
+
+    return true;
+}
+
 bool
 Test_MintAndSpend() {
     try {
@@ -448,6 +482,7 @@ Test_RunAllTests() {
     LogTestResult("invalid coins will be rejected", Test_InvalidCoin);
     LogTestResult("the accumulator works", Test_Accumulator);
     LogTestResult("the commitment equality PoK works", Test_EqualityPoK);
+    LogTestResult("fixed-base exponentiation matches pow_mod", Test_FixedBaseExp);
     LogTestResult("a minted coin can be spent", Test_MintAndSpend);
 
     cout << endl << "Average coin size is " << gCoinSize << " bytes." << endl;
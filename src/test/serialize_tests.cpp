@@ -154,4 +154,28 @@ BOOST_AUTO_TEST_CASE(insert_delete) {
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(span_stream) {
+    CDataStream ss(SER_DISK, 0);
+    std::vector<int> vIn;
+    for (int i = 0; i < 100; i++)
+        vIn.push_back(i * 1000);
+    ss << VARINT(1234567) << vIn << std::string("span");
+
+    // Deserializing from the raw bytes gives the same values as the owning stream would
+    CSpanStream span(&ss[0], &ss[0] + ss.size(), SER_DISK, 0);
+    int n = 0;
+    std::vector<int> vOut;
+    std::string str;
+    span >> VARINT(n) >> vOut >> str;
+    BOOST_CHECK_EQUAL(n, 1234567);
+    BOOST_CHECK(vOut == vIn);
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK(span.empty());
+
+    // Reading past the end throws instead of running off the buffer
+    CSpanStream truncated(&ss[0], &ss[0] + ss.size() - 1, SER_DISK, 0);
+    truncated >> VARINT(n) >> vOut;
+    BOOST_CHECK_THROW(truncated >> str, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -487,4 +487,32 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test99) {
     nValueTarget += OneCoinAmount;
 }
 
+BOOST_AUTO_TEST_CASE(zerocoin_supply_serialize_test) {
+    cout << "Running zerocoin_supply_serialize_test...\n";
+
+    // the flat supply array has to stay byte compatible with the std::map stored in the block index
+    std::map<CoinDenomination, int64_t> mapSupply;
+    CZerocoinSupply supply;
+    int64_t nCount = 3;
+    for (CoinDenomination denom : zerocoinDenomList) {
+        mapSupply[denom] = nCount;
+        supply.at(denom) = nCount;
+        nCount *= 7;
+    }
+
+    CDataStream ssMap(SER_DISK, CLIENT_VERSION);
+    ssMap << mapSupply;
+    CDataStream ssSupply(SER_DISK, CLIENT_VERSION);
+    ssSupply << supply;
+    BOOST_CHECK(ssMap.str() == ssSupply.str());
+    BOOST_CHECK_EQUAL(ssSupply.size(), ::GetSerializeSize(supply, SER_DISK, CLIENT_VERSION));
+
+    CZerocoinSupply supplyRead;
+    ssMap >> supplyRead;
+    for (CoinDenomination denom : zerocoinDenomList)
+        BOOST_CHECK_EQUAL(supplyRead.at(denom), mapSupply.at(denom));
+
+    BOOST_CHECK_THROW(supply.at(ZQ_ERROR), std::out_of_range);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
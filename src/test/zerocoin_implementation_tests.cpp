@@ -10,6 +10,7 @@
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 #include <accumulators.h>
+#include <accumulatormap.h>
 
 using namespace libzerocoin;
 
@@ -337,5 +338,26 @@ BOOST_AUTO_TEST_CASE(checksum_tests) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(accumulatormap_batch_test) {
+    cout << "Running accumulatormap_batch_test\n";
+
+    // two coins of each of the first three denominations
+    vector<PublicCoin> vCoins;
+    for (int i = 0; i < 6; i++) {
+        PrivateCoin coin(Params().Zerocoin_Params(), zerocoinDenomList[i / 2]);
+        vCoins.push_back(coin.getPublicCoin());
+    }
+
+    AccumulatorMap mapSequential;
+    for (const PublicCoin& coin : vCoins)
+        BOOST_CHECK(mapSequential.Accumulate(coin));
+
+    AccumulatorMap mapBatch;
+    BOOST_CHECK(mapBatch.Accumulate(vCoins));
+
+    for (auto& denom : zerocoinDenomList)
+        BOOST_CHECK_MESSAGE(mapBatch.GetValue(denom) == mapSequential.GetValue(denom), "batch accumulation differs");
+    BOOST_CHECK(mapBatch.GetCheckpoint() == mapSequential.GetCheckpoint());
+}
 
 BOOST_AUTO_TEST_SUITE_END()
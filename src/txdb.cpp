@@ -11,6 +11,7 @@
 #include "uint256.h"
 #include "accumulators.h"
 
+#include <atomic>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -74,6 +75,13 @@ bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex) {
     return Write(make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
+bool CBlockTreeDB::WriteBlockIndexes(const std::vector<CBlockIndex*>& vBlockIndex) {
+    CLevelDBBatch batch;
+    for (CBlockIndex* pindex : vBlockIndex)
+        batch.Write(make_pair('b', pindex->GetBlockHash()), CDiskBlockIndex(pindex));
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteBlockFileInfo(int nFile, const CBlockFileInfo& info) {
     return Write(make_pair('f', nFile), info);
 }
@@ -186,6 +194,9 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue) {
     return Read(std::make_pair('I', name), nValue);
 }
 
+/** Number of block index records decoded together at startup */
+static const size_t BLOCK_INDEX_LOAD_BATCH = 16384;
+
 bool CBlockTreeDB::LoadBlockIndexGuts() {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
@@ -193,77 +204,123 @@ bool CBlockTreeDB::LoadBlockIndexGuts() {
     ssKeySet << make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
 
+    // size the hash table for the number of entries loaded at the previous start
+    int nBlockIndexSize = 0;
+    if (ReadInt("blockindexsize", nBlockIndexSize) && nBlockIndexSize > 0)
+        mapBlockIndex.reserve(nBlockIndexSize);
+
     // Load mapBlockIndex
     uint256 nPreviousCheckpoint;
+    std::vector<uint256> vHashes;
+    std::vector<std::string> vValues;
+    std::vector<CDiskBlockIndex> vDiskIndex;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
+
+        // Collect a batch of raw records. The block hash is part of the key, so the
+        // header does not have to be hashed again.
+        vHashes.clear();
+        vValues.clear();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
+            while (pcursor->Valid() && vValues.size() < BLOCK_INDEX_LOAD_BATCH) {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b')
+                    break; // finished loading block index
+
+                uint256 hash;
+                ssKey >> hash;
+                vHashes.push_back(hash);
                 leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                //if (fDebug) LogPrintf("%s: %s\n", pindexNew->hashMerkleRoot.ToString().c_str(), pindexNew->GetBlockHash().ToString().c_str());
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
-
+                vValues.push_back(std::string(slValue.data(), slValue.size()));
                 pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
             }
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+        if (vValues.empty())
+            break;
+
+        // Decode the batch on several threads. The proof of each block only depends on its own
+        // header, it is computed here and summed along the chain by LoadBlockIndexDB.
+        vDiskIndex.assign(vValues.size(), CDiskBlockIndex());
+        std::atomic<size_t> nNext(0);
+        std::atomic<bool> fFailed(false);
+        auto decodeRecords = [&]() {
+            for (size_t i = nNext++; i < vValues.size(); i = nNext++) {
+                try {
+                    CDataStream ssValue(vValues[i].data(), vValues[i].data() + vValues[i].size(), SER_DISK, CLIENT_VERSION);
+                    ssValue >> vDiskIndex[i];
+                    vDiskIndex[i].nChainWork = GetBlockProof(vDiskIndex[i]);
+                } catch (const std::exception& e) {
+                    fFailed = true;
+                }
+            }
+        };
+        boost::thread_group threads;
+        for (int i = 1; i < std::max(nScriptCheckThreads, 1); i++)
+            threads.create_thread(decodeRecords);
+        decodeRecords();
+        threads.join_all();
+        if (fFailed)
+            return error("%s : Deserialize or I/O error", __func__);
+
+        for (size_t i = 0; i < vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(vHashes[i]);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+            pindexNew->nChainWork = diskindex.nChainWork;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
+            pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            //if (fDebug) LogPrintf("%s: %s\n", pindexNew->hashMerkleRoot.ToString().c_str(), pindexNew->GetBlockHash().ToString().c_str());
+
+            if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
+                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
+                    return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+            }
+
+            // ppcoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+            //populate accumulator checksum map in memory
+            if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+                LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+                nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+            }
+        }
     }
 
+    WriteInt("blockindexsize", (int)mapBlockIndex.size());
     return true;
 }
 
@@ -332,3 +389,27 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum) {
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('a', nChecksum));
 }
+
+bool CZerocoinDB::WriteBlockMints(const uint256& hashBlock, const std::list<PublicCoin>& listPubcoins) {
+    std::vector<std::pair<CBigNum, int> > vMints;
+    vMints.reserve(listPubcoins.size());
+    for (const PublicCoin& pubcoin : listPubcoins)
+        vMints.push_back(make_pair(pubcoin.getValue(), (int)pubcoin.getDenomination()));
+
+    return Write(make_pair('b', hashBlock), vMints);
+}
+
+bool CZerocoinDB::ReadBlockMints(const uint256& hashBlock, std::list<PublicCoin>& listPubcoins) {
+    std::vector<std::pair<CBigNum, int> > vMints;
+    if (!Read(make_pair('b', hashBlock), vMints))
+        return false;
+
+    for (const std::pair<CBigNum, int>& mint : vMints)
+        listPubcoins.emplace_back(PublicCoin(Params().Zerocoin_Params(), mint.first, (CoinDenomination)mint.second));
+
+    return true;
+}
+
+bool CZerocoinDB::EraseBlockMints(const uint256& hashBlock) {
+    return Erase(make_pair('b', hashBlock));
+}
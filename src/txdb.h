@@ -11,6 +11,7 @@
 #include "main.h"
 #include "primitives/zerocoin.h"
 
+#include <list>
 #include <map>
 #include <string>
 #include <utility>
@@ -52,6 +53,7 @@ class CBlockTreeDB : public CLevelDBWrapper {
 
   public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    bool WriteBlockIndexes(const std::vector<CBlockIndex*>& vBlockIndex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool WriteBlockFileInfo(int nFile, const CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
@@ -85,6 +87,11 @@ class CZerocoinDB : public CLevelDBWrapper {
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+
+    /** Pubcoins minted by a block, in block order, so accumulator code does not have to read the block file */
+    bool WriteBlockMints(const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins);
+    bool ReadBlockMints(const uint256& hashBlock, std::list<libzerocoin::PublicCoin>& listPubcoins);
+    bool EraseBlockMints(const uint256& hashBlock);
 };
 
 #endif // BITCOIN_TXDB_H
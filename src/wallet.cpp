@@ -12,6 +12,7 @@
 #include "base58.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
 #include "net.h"
@@ -31,6 +32,7 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 #include <algorithm>
+#include <atomic>
 #include <boost/filesystem/operations.hpp>
 
 using namespace std;
@@ -158,6 +160,10 @@ bool CWallet::LoadCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigne
 bool CWallet::AddCScript(const CScript& redeemScript) {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    {
+        LOCK(cs_wallet);
+        ResetAvailableCoinsIndex();
+    }
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -180,6 +186,10 @@ bool CWallet::LoadCScript(const CScript& redeemScript) {
 bool CWallet::AddWatchOnly(const CScript& dest) {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    {
+        LOCK(cs_wallet);
+        ResetAvailableCoinsIndex();
+    }
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -207,6 +217,10 @@ bool CWallet::LoadWatchOnly(const CScript& dest) {
 bool CWallet::AddMultiSig(const CScript& dest) {
     if (!CCryptoKeyStore::AddMultiSig(dest))
         return false;
+    {
+        LOCK(cs_wallet);
+        ResetAvailableCoinsIndex();
+    }
     nTimeFirstKey = 1; // No birthday information
     NotifyMultiSigChanged(true);
     if (!fFileBacked)
@@ -307,6 +321,14 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 
 void CWallet::SetBestChain(const CBlockLocator& loc) {
     CWalletDB walletdb(strWalletFile);
+    {
+        LOCK(cs_wallet);
+        // blocks skipped by an aborted rescan must not be recorded as scanned
+        if (fRescanAborted) {
+            walletdb.WriteBestBlock(locatorRescanAborted);
+            return;
+        }
+    }
     walletdb.WriteBestBlock(loc);
 }
 
@@ -417,6 +439,63 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const {
     return false;
 }
 
+/** Whether an output is spent by a wallet transaction that made it into the active chain */
+bool CWallet::IsSpentInChain(const uint256& hash, unsigned int n) const {
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, n));
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0)
+            return true;
+    }
+    return false;
+}
+
+void CWallet::ResetAvailableCoinsIndex() {
+    AssertLockHeld(cs_wallet);
+    setAvailableCoinsTxs.clear();
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        setAvailableCoinsTxs.insert(setAvailableCoinsTxs.end(), it->first);
+    pindexAvailableCoins = NULL;
+}
+
+/** Drop the transactions that can no longer have available outputs, once per new chain tip */
+void CWallet::UpdateAvailableCoinsIndex() const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (pindexAvailableCoins == chainActive.Tip())
+        return;
+    // a spend that was disconnected may be unconfirmed or conflicted now
+    if (pindexAvailableCoins && !chainActive.Contains(pindexAvailableCoins))
+        const_cast<CWallet*>(this)->ResetAvailableCoinsIndex();
+
+    for (std::set<uint256>::iterator it = setAvailableCoinsTxs.begin(); it != setAvailableCoinsTxs.end();) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        bool fAvailable = false;
+        if (mi != mapWallet.end()) {
+            const CWalletTx& wtx = mi->second;
+            for (unsigned int i = 0; i < wtx.vout.size() && !fAvailable; i++)
+                fAvailable = IsMine(wtx.vout[i]) != ISMINE_NO && !IsSpentInChain(*it, i);
+        }
+        if (fAvailable)
+            ++it;
+        else
+            it = setAvailableCoinsTxs.erase(it);
+    }
+    pindexAvailableCoins = chainActive.Tip();
+}
+
+std::vector<const CWalletTx*> CWallet::GetAvailableCoinsTxs() const {
+    UpdateAvailableCoinsIndex();
+    std::vector<const CWalletTx*> vTxs;
+    vTxs.reserve(setAvailableCoinsTxs.size());
+    for (std::set<uint256>::const_iterator it = setAvailableCoinsTxs.begin(); it != setAvailableCoinsTxs.end(); ++it) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        if (mi != mapWallet.end())
+            vTxs.push_back(&mi->second);
+    }
+    return vTxs;
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid) {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
 
@@ -627,6 +706,8 @@ void CWallet::MarkDirty() {
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx) & item, mapWallet) {
             item.second.MarkDirty();
         }
+        // called after keys were imported, which may have made more outputs ours
+        ResetAvailableCoinsIndex();
     }
 }
 
@@ -637,12 +718,14 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet) {
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        setAvailableCoinsTxs.insert(hash);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
         pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
+        setAvailableCoinsTxs.insert(hash);
         bool fInsertedNew = ret.second;
         if (fInsertedNew) {
             wtx.nTimeReceived = GetAdjustedTime();
@@ -772,8 +855,11 @@ void CWallet::EraseFromWallet(const uint256& hash) {
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            // the outputs it spent are unspent again
+            ResetAvailableCoinsIndex();
+        }
     }
     return;
 }
@@ -1084,12 +1170,24 @@ bool CWalletTx::WriteToDisk() {
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+/** Number of blocks read and filtered in parallel before their transactions are added in chain order */
+static const int RESCAN_BLOCKS_PER_BATCH = 100;
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and their outputs matched against the key store on several threads. Whether a
+ * transaction spends our coins depends on the ones found before it, so that check and adding the
+ * transactions to the wallet happen here, in chain order.
+ *
+ * A shutdown request stops the scan between batches and sets pfAborted. The wallet's best block
+ * is then held back to the last block scanned, so the rest is scanned again on the next start.
  */
-int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate) {
+int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool* pfAborted) {
+    if (pfAborted)
+        *pfAborted = false;
     int ret = 0;
     int64_t nNow = GetTime();
 
@@ -1106,17 +1204,55 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate) {
         double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
         while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+            if (ShutdownRequested()) {
+                LogPrintf("Rescan aborted at block %d\n", pindex->nHeight);
+                // batches are added completely, so everything before pindex was scanned
+                CBlockLocator locator = pindex->pprev ? chainActive.GetLocator(pindex->pprev) : CBlockLocator();
+                if (!fRescanAborted || FindForkInGlobalIndex(chainActive, locator)->nHeight < FindForkInGlobalIndex(chainActive, locatorRescanAborted)->nHeight)
+                    locatorRescanAborted = locator;
+                fRescanAborted = true;
+                if (pfAborted)
+                    *pfAborted = true;
+                break;
+            }
+            if (dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+            std::vector<CBlockIndex*> vBatch;
+            for (; pindex && vBatch.size() < (size_t)RESCAN_BLOCKS_PER_BATCH; pindex = chainActive.Next(pindex))
+                vBatch.push_back(pindex);
+
+            // read the blocks and find the transactions paying to us
+            std::vector<CBlock> vBlocks(vBatch.size());
+            std::vector<std::vector<char> > vfMine(vBatch.size());
+            std::atomic<size_t> nNext(0);
+            auto readBlocks = [&]() {
+                for (size_t i = nNext++; i < vBatch.size(); i = nNext++) {
+                    ReadBlockFromDisk(vBlocks[i], vBatch[i]);
+                    vfMine[i].resize(vBlocks[i].vtx.size());
+                    for (unsigned int j = 0; j < vBlocks[i].vtx.size(); j++)
+                        vfMine[i][j] = IsMine(vBlocks[i].vtx[j]);
+                }
+            };
+            boost::thread_group threads;
+            for (int i = 1; i < std::max(nScriptCheckThreads, 1); i++)
+                threads.create_thread(readBlocks);
+            readBlocks();
+            threads.join_all();
+
+            for (size_t i = 0; i < vBatch.size(); i++) {
+                const CBlock& block = vBlocks[i];
+                for (unsigned int j = 0; j < block.vtx.size(); j++) {
+                    const CTransaction& tx = block.vtx[j];
+                    // AddToWalletIfInvolvingMe() only needs to run for the transactions it could add
+                    if (!vfMine[i][j] && !mapWallet.count(tx.GetHash()) && !IsFromMe(tx))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                        ret++;
+                }
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
+
+            if (pindex && GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
             }
@@ -1226,8 +1362,7 @@ CAmount CWallet::GetBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1244,10 +1379,15 @@ CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const {
         myZerocoinSupply.insert(make_pair(denom, 0));
     }
 
+    LOCK2(cs_main, cs_wallet);
+    CZerocoinBalanceCache& cache = fMatureOnly ? zerocoinBalanceMature : zerocoinBalanceAll;
+    if (GetCachedZerocoinBalance(cache, nTotal))
+        return nTotal;
+    unsigned int nMintsVersion = GetZerocoinMintsVersion();
+
     {
-        LOCK2(cs_main, cs_wallet);
         // Get Unused coins
-        list<CZerocoinMint> listPubCoin = CWalletDB(strWalletFile).ListMintedCoins(true, fMatureOnly, true);
+        list<CZerocoinMint> listPubCoin = ListMintedCoins(true, fMatureOnly, true);
         for (auto& mint : listPubCoin) {
             libzerocoin::CoinDenomination denom = mint.GetDenomination();
             nTotal += libzerocoin::ZerocoinDenominationToAmount(denom);
@@ -1261,6 +1401,7 @@ CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const {
 
     if (nTotal < 0 ) nTotal = 0; // Sanity never hurts
 
+    SetCachedZerocoinBalance(cache, nMintsVersion, nTotal);
     return nTotal;
 }
 
@@ -1270,8 +1411,12 @@ CAmount CWallet::GetImmatureZerocoinBalance() const {
 
 CAmount CWallet::GetUnconfirmedZerocoinBalance() const {
     CAmount nUnconfirmed = 0;
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(true, false, true);
+    LOCK2(cs_main, cs_wallet);
+    if (GetCachedZerocoinBalance(zerocoinBalanceUnconfirmed, nUnconfirmed))
+        return nUnconfirmed;
+    unsigned int nMintsVersion = GetZerocoinMintsVersion();
+
+    list<CZerocoinMint> listMints = ListMintedCoins(true, false, true);
 
     std::map<libzerocoin::CoinDenomination, int> mapUnconfirmed;
     for (const auto& denom : libzerocoin::zerocoinDenomList) {
@@ -1279,7 +1424,6 @@ CAmount CWallet::GetUnconfirmedZerocoinBalance() const {
     }
 
     {
-        LOCK2(cs_main, cs_wallet);
         for (auto& mint : listMints) {
             if (!mint.GetHeight() || mint.GetHeight() > chainActive.Height() - Params().Zerocoin_MintRequiredConfirmations()) {
                 libzerocoin::CoinDenomination denom = mint.GetDenomination();
@@ -1297,18 +1441,36 @@ CAmount CWallet::GetUnconfirmedZerocoinBalance() const {
 
     if (nUnconfirmed < 0 ) nUnconfirmed = 0; // Sanity never hurts
 
+    SetCachedZerocoinBalance(zerocoinBalanceUnconfirmed, nMintsVersion, nUnconfirmed);
     return nUnconfirmed;
 }
 
+/** Look up a zerocoin balance computed for the current chain tip and mints. Requires cs_main and cs_wallet */
+bool CWallet::GetCachedZerocoinBalance(const CZerocoinBalanceCache& cache, CAmount& nAmount) const {
+    if (!cache.fValid || cache.pindex != chainActive.Tip() || cache.nMintsVersion != GetZerocoinMintsVersion())
+        return false;
+    nAmount = cache.nAmount;
+    return true;
+}
+
+/**
+ * Remember a zerocoin balance. nMintsVersion must have been taken before the mints were listed, so that
+ * any change made while listing them, such as a mint getting its height, invalidates the result.
+ */
+void CWallet::SetCachedZerocoinBalance(CZerocoinBalanceCache& cache, unsigned int nMintsVersion, CAmount nAmount) const {
+    cache.fValid = true;
+    cache.pindex = chainActive.Tip();
+    cache.nMintsVersion = nMintsVersion;
+    cache.nAmount = nAmount;
+}
+
 CAmount CWallet::GetUnlockedCoins() const {
     if (fLiteMode) return 0;
 
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetUnlockedCredit();
         }
@@ -1323,9 +1485,7 @@ CAmount CWallet::GetLockedCoins() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetLockedCredit();
         }
@@ -1341,7 +1501,7 @@ std::map<libzerocoin::CoinDenomination, CAmount> CWallet::GetMyZerocoinDistribut
         spread.insert(std::pair<libzerocoin::CoinDenomination, CAmount>(denom, 0));
     {
         LOCK2(cs_main, cs_wallet);
-        list<CZerocoinMint> listPubCoin = CWalletDB(strWalletFile).ListMintedCoins(true, true, true);
+        list<CZerocoinMint> listPubCoin = ListMintedCoins(true, true, true);
         for (auto& mint : listPubCoin)
             spread.at(mint.GetDenomination())++;
     }
@@ -1355,9 +1515,7 @@ CAmount CWallet::GetAnonymizableBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAnonymizableCredit();
         }
@@ -1372,9 +1530,7 @@ CAmount CWallet::GetAnonymizedBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAnonymizedCredit();
         }
@@ -1393,10 +1549,8 @@ double CWallet::GetAverageAnonymizedRounds() const {
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
+            uint256 hash = pcoin->GetHash();
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1424,10 +1578,8 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const {
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
+            uint256 hash = pcoin->GetHash();
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1450,9 +1602,7 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             nTotal += pcoin->GetDenominatedCredit(unconfirmed);
         }
     }
@@ -1464,8 +1614,7 @@ CAmount CWallet::GetUnconfirmedBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1477,8 +1626,7 @@ CAmount CWallet::GetImmatureBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -1489,8 +1637,7 @@ CAmount CWallet::GetWatchOnlyBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -1503,8 +1650,7 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -1516,8 +1662,7 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH(const CWalletTx* pcoin, GetAvailableCoinsTxs()) {
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -1532,7 +1677,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        UpdateAvailableCoinsIndex();
+        for (std::set<uint256>::const_iterator itTx = setAvailableCoinsTxs.begin(); itTx != setAvailableCoinsTxs.end(); ++itTx) {
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(*itTx);
+            if (it == mapWallet.end())
+                continue;
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
 
@@ -2479,6 +2628,107 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CWa
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, strFailReason, coinControl, coin_type, useIX, nFeePay);
 }
 
+/**
+ * Search the stake set for a coin whose kernel meets the target, on -stakethreads threads.
+ * Workers take the next unchecked coin from a shared position, so a thread that hits cheap
+ * coins keeps taking work from the others, and all of them stop once a kernel is found.
+ * Returns the position of the kernel in vStakeCoins with its time in nTxNewTime, or -1.
+ */
+int CWallet::FindStakeKernel(const std::vector<std::pair<const CWalletTx*, unsigned int> >& vStakeCoins, unsigned int nBits, unsigned int& nTxNewTime) {
+    int nThreads = GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(std::min(nThreads, MAX_STAKE_THREADS), (int)vStakeCoins.size()));
+
+    // The workers run without cs_main, so everything they need from the block index is looked up here
+    int64_t nMedianTimePast;
+    std::vector<CBlockHeader> vBlockFrom(vStakeCoins.size());
+    std::vector<CKernelStakeModifier> vModifiers(vStakeCoins.size());
+    std::vector<char> vfCandidate(vStakeCoins.size(), false);
+    {
+        LOCK(cs_main);
+        nMedianTimePast = chainActive.Tip()->GetMedianTimePast();
+        for (size_t i = 0; i < vStakeCoins.size(); i++) {
+            //make sure that enough time has elapsed between
+            BlockMap::iterator it = mapBlockIndex.find(vStakeCoins[i].first->hashBlock);
+            if (it == mapBlockIndex.end()) {
+                if (fDebug)
+                    LogPrintf("CreateCoinStake() failed to find block index \n");
+                continue;
+            }
+
+            // Read block header
+            vBlockFrom[i] = it->second->GetBlockHeader();
+            if (!GetKernelStakeModifier(vBlockFrom[i].GetHash(), vModifiers[i])) {
+                LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
+                continue;
+            }
+            vfCandidate[i] = true;
+        }
+    }
+
+    std::atomic<size_t> nNext(0);
+    std::atomic<int64_t> nHashed(0);
+    std::atomic<bool> fFound(false);
+    boost::mutex csFound;
+    int nKernel = -1;
+
+    auto worker = [&]() {
+        size_t i;
+        while (!fFound && (i = nNext++) < vStakeCoins.size()) {
+            if (!vfCandidate[i])
+                continue;
+            const std::pair<const CWalletTx*, unsigned int>& pcoin = vStakeCoins[i];
+
+            uint256 hashProofOfStake = 0;
+            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+            unsigned int nTime = GetAdjustedTime();
+            nHashed++;
+
+            //iterates each utxo inside of CheckStakeKernelHash()
+            if (!CheckStakeKernelHash(nBits, vBlockFrom[i], vModifiers[i], *pcoin.first, prevoutStake, nTime, nHashDrift, false, hashProofOfStake, true))
+                continue;
+
+            //Double check that this will pass time requirements
+            if (nTime <= nMedianTimePast) {
+                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
+                continue;
+            }
+
+            // Prefer the first kernel in set order, as a single thread would
+            boost::unique_lock<boost::mutex> lock(csFound);
+            if (nKernel < 0 || (int)i < nKernel) {
+                nKernel = i;
+                nTxNewTime = nTime;
+            }
+            fFound = true;
+        }
+    };
+
+    int64_t nStart = GetTimeMicros();
+    if (nThreads == 1) {
+        worker();
+    } else {
+        // The workers reference this stack frame, so they must be joined even when interrupted
+        boost::this_thread::disable_interruption di;
+        boost::thread_group workers;
+        for (int i = 0; i < nThreads; i++)
+            workers.create_thread(worker);
+        workers.join_all();
+    }
+
+    if (nHashed > 0) {
+        mapHashedBlocks.clear();
+        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
+
+    LOCK(cs_wallet);
+    nStakeSearchThreads = nThreads;
+    nStakeSearchCoins = nHashed;
+    nStakeSearchMicros = GetTimeMicros() - nStart;
+    return nKernel;
+}
+
 // ppcoin: create coin stake transaction
 bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, unsigned int& nTxNewTime) {
     // The following split & combine thresholds are important to security
@@ -2527,99 +2777,71 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
-    BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
-        }
+    std::vector<pair<const CWalletTx*, unsigned int> > vStakeCoins(setStakeCoins.begin(), setStakeCoins.end());
+    int nKernel = FindStakeKernel(vStakeCoins, nBits, nTxNewTime);
+    if (nKernel < 0)
+        return false;
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
+    const pair<const CWalletTx*, unsigned int>& pcoin = vStakeCoins[nKernel];
+    // Found a kernel
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("CreateCoinStake : kernel found\n");
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    CScript scriptPubKeyOut;
+    scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+    if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+        LogPrintf("CreateCoinStake : failed to parse kernel\n");
+        return false;
+    }
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+    if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+        return false; // only support pay to public key and pay to address
+    }
+    if (whichType == TX_PUBKEYHASH) { // pay to address type
+        //convert to pay to public key type
+        CKey key;
+        if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
+            if (fDebug && GetBoolArg("-printcoinstake", false))
+                LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+            return false; // unable to find corresponding public key
+        }
 
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+        scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+    } else
+        scriptPubKeyOut = scriptPubKeyKernel;
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
+    txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+    nCredit += pcoin.first->vout[pcoin.second].nValue;
+    vwtxPrev.push_back(pcoin.first);
+    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
-                if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
-            }
-            if (whichType == TX_PUBKEYHASH) { // pay to address type
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
-
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
-
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
-
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            // Split should happen equally as long as the remainder does not equal less than the threshold.
-            if ((nTotalSize / 2) > thold) {
-                LogPrintf("CreateCoinStake : split=%d threshold=%d breached=%d\n", nTotalSize, thold, (nTotalSize / 2));
-                // Start 1 off to account for stake transaction already added above.
-                for (int i = 1; i < (nTotalSize / thold); i++) {
-                    LogPrintf("CreateCoinStake : adding split threshold tx=%d\n", i);
-                    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
-                }
-            }
+    //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+    const CBlockIndex* pIndex0 = chainActive.Tip();
+    uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
 
-            if (fDebug && GetBoolArg("-printcoinstake", false)) LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
+    //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+    // Split should happen equally as long as the remainder does not equal less than the threshold.
+    if ((nTotalSize / 2) > thold) {
+        LogPrintf("CreateCoinStake : split=%d threshold=%d breached=%d\n", nTotalSize, thold, (nTotalSize / 2));
+        // Start 1 off to account for stake transaction already added above.
+        for (int i = 1; i < (nTotalSize / thold); i++) {
+            LogPrintf("CreateCoinStake : adding split threshold tx=%d\n", i);
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
     }
+
+    if (fDebug && GetBoolArg("-printcoinstake", false)) LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
+
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
 
     // Calculate reward
     CAmount nReward;
-    const CBlockIndex* pIndex0 = chainActive.Tip();
+    pIndex0 = chainActive.Tip();
     nReward = GetBlockValue(pIndex0->nHeight);
     nCredit += nReward;
 
@@ -2920,6 +3142,8 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet) {
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    LoadZerocoinSerials();
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -4045,7 +4269,9 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
     libzerocoin::AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, pubCoinSelected);
     string strFailReason = "";
     int nMintsAdded = 0;
-    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason)) {
+    CAccumulatorWitnessSnapshot snapshot;
+    bool fSnapshot = CWalletDB(strWalletFile).ReadZerocoinWitness(pubCoinSelected.getValue(), snapshot);
+    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, fSnapshot ? &snapshot : NULL)) {
         receipt.SetStatus(_("Try to spend with a higher security level to include more coins"), ZIDC_FAILED_ACCUMULATOR_INITIALIZATION);
         LogPrintf("%s : %s \n", __func__, receipt.GetStatusMessage());
         return false;
@@ -4099,8 +4325,9 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
         for (const CBigNum& item : listCoinSpendSerial) {
             if (spend.getCoinSerialNumber() == item) {
                 //Tried to spend an already spent zIDC
+                LOCK(cs_wallet);
                 zerocoinSelected.SetUsed(true);
-                if (!CWalletDB(strWalletFile).WriteZerocoinMint(zerocoinSelected))
+                if (!WriteZerocoinMint(zerocoinSelected))
                     LogPrintf("%s failed to write zerocoinmint\n", __func__);
 
                 pwalletMain->NotifyZerocoinChanged(pwalletMain, zerocoinSelected.GetValue().GetHex(), "Used", CT_UPDATED);
@@ -4140,14 +4367,13 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
     nStatus = ZIDC_TRX_CREATE;
 
     // If not already given pre-selected mints, then select mints from the wallet
-    CWalletDB walletdb(pwalletMain->strWalletFile);
     list<CZerocoinMint> listMints;
     CAmount nValueSelected = 0;
     int nCoinsReturned = 0; // Number of coins returned in change from function below (for debug)
     int nNeededSpends = 0;  // Number of spends which would be needed if selection failed
     const int nMaxSpends = Params().Zerocoin_MaxSpendsPerTransaction(); // Maximum possible spends for one zIDC transaction
     if (vSelectedMints.empty()) {
-        listMints = walletdb.ListMintedCoins(true, true, true); // need to find mints to spend
+        listMints = ListMintedCoins(true, true, true); // need to find mints to spend
         if(listMints.empty()) {
             receipt.SetStatus(_("Failed to find Zerocoins in in wallet.dat"), nStatus);
             return false;
@@ -4177,8 +4403,9 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
         if (IsSerialKnown(mint.GetSerialNumber())) {
             receipt.SetStatus(_("Trying to spend an already spent serial #, try again."), nStatus);
 
+            LOCK(cs_wallet);
             mint.SetUsed(true);
-            walletdb.WriteZerocoinMint(mint);
+            WriteZerocoinMint(mint);
 
             return false;
         }
@@ -4197,7 +4424,8 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
 
         // archive this mint as an orphan
         if (fArchive) {
-            walletdb.ArchiveMintOrphan(mint);
+            LOCK(cs_wallet);
+            ArchiveMintOrphan(mint);
             nArchived++;
         }
     }
@@ -4298,7 +4526,7 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
             for (CZerocoinSpend spend : receipt.GetSpends()) {
                 spend.SetTxHash(txHash);
 
-                if (!CWalletDB(strWalletFile).WriteZerocoinSpendSerialEntry(spend)) {
+                if (!WriteZerocoinSpendSerialEntry(spend)) {
                     receipt.SetStatus(_("Failed to write coin serial number into wallet"), nStatus);
                 }
             }
@@ -4319,9 +4547,8 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
 string CWallet::ResetMintZerocoin(bool fExtendedSearch) {
     long updates = 0;
     long deletions = 0;
-    CWalletDB walletdb(pwalletMain->strWalletFile);
 
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, true);
+    list<CZerocoinMint> listMints = ListMintedCoins(false, false, true);
     vector<CZerocoinMint> vMintsToFind{ std::make_move_iterator(std::begin(listMints)), std::make_move_iterator(std::end(listMints)) };
     vector<CZerocoinMint> vMintsMissing;
     vector<CZerocoinMint> vMintsToUpdate;
@@ -4329,16 +4556,19 @@ string CWallet::ResetMintZerocoin(bool fExtendedSearch) {
     // search all of our available data for these mints
     FindMints(vMintsToFind, vMintsToUpdate, vMintsMissing, fExtendedSearch);
 
+    // spending or archiving a mint erases its witness snapshot, see UpdateZerocoinWitnesses()
+    LOCK(cs_wallet);
+
     // Update the meta data of mints that were marked for updating
     for (CZerocoinMint mint : vMintsToUpdate) {
         updates++;
-        walletdb.WriteZerocoinMint(mint);
+        WriteZerocoinMint(mint);
     }
 
     // Delete any mints that were unable to be located on the blockchain
     for (CZerocoinMint mint : vMintsMissing) {
         deletions++;
-        walletdb.ArchiveMintOrphan(mint);
+        ArchiveMintOrphan(mint);
     }
 
     string strResult = _("ResetMintZerocoin finished: ") + to_string(updates) + _(" mints updated, ") + to_string(deletions) + _(" mints deleted\n");
@@ -4349,7 +4579,7 @@ string CWallet::ResetSpentZerocoin() {
     long removed = 0;
     CWalletDB walletdb(pwalletMain->strWalletFile);
 
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, false);
+    list<CZerocoinMint> listMints = ListMintedCoins(false, false, false);
     list<CZerocoinSpend> listSpends = walletdb.ListSpentCoins();
     list<CZerocoinSpend> listUnconfirmedSpends;
 
@@ -4372,7 +4602,7 @@ string CWallet::ResetSpentZerocoin() {
                 removed++;
                 mint.SetUsed(false);
                 RemoveSerialFromDB(spend.GetSerial());
-                walletdb.WriteZerocoinMint(mint);
+                WriteZerocoinMint(mint);
                 walletdb.EraseZerocoinSpendSerialEntry(spend.GetSerial());
                 continue;
             }
@@ -4405,7 +4635,7 @@ void CWallet::ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored) {
 
         mint.SetTxHash(txHash);
         mint.SetHeight(mapBlockIndex.at(hashBlock)->nHeight);
-        if (!walletdb.UnarchiveZerocoin(mint)) {
+        if (!UnarchiveZerocoin(mint)) {
             LogPrintf("%s : failed to unarchive mint %s\n", __func__, mint.GetValue().GetHex());
         }
         listMintsRestored.emplace_back(mint);
@@ -4452,6 +4682,174 @@ void CWallet::ZIDCBackupWallet() {
     BackupWallet(*this, backupPath.string());
 }
 
+void CWallet::LoadZerocoinSerials() {
+    std::list<CBigNum> listSerials = CWalletDB(strWalletFile).ListMintedCoinsSerial();
+
+    boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+    setZerocoinSerials.clear();
+    setZerocoinSerials.insert(listSerials.begin(), listSerials.end());
+    nZerocoinMintsVersion++;
+    LogPrintf("%s : %d unspent zerocoin serials\n", __func__, setZerocoinSerials.size());
+}
+
+void CWallet::AddZerocoinSerial(const CBigNum& bnSerial) const {
+    boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+    setZerocoinSerials.insert(bnSerial);
+    nZerocoinMintsVersion++;
+}
+
+void CWallet::EraseZerocoinSerial(const CBigNum& bnSerial) const {
+    boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+    setZerocoinSerials.erase(bnSerial);
+    nZerocoinMintsVersion++;
+}
+
+bool CWallet::WriteZerocoinMint(const CZerocoinMint& mint) {
+    if (!CWalletDB(strWalletFile).WriteZerocoinMint(mint))
+        return false;
+
+    if (mint.IsUsed())
+        EraseZerocoinSerial(mint.GetSerialNumber());
+    else
+        AddZerocoinSerial(mint.GetSerialNumber());
+    return true;
+}
+
+bool CWallet::EraseZerocoinMint(const CZerocoinMint& mint) {
+    EraseZerocoinSerial(mint.GetSerialNumber());
+    return CWalletDB(strWalletFile).EraseZerocoinMint(mint);
+}
+
+bool CWallet::ArchiveMintOrphan(const CZerocoinMint& mint) {
+    EraseZerocoinSerial(mint.GetSerialNumber());
+    return CWalletDB(strWalletFile).ArchiveMintOrphan(mint);
+}
+
+bool CWallet::UnarchiveZerocoin(const CZerocoinMint& mint) {
+    if (!CWalletDB(strWalletFile).UnarchiveZerocoin(mint))
+        return false;
+
+    if (!mint.IsUsed())
+        AddZerocoinSerial(mint.GetSerialNumber());
+    return true;
+}
+
+bool CWallet::WriteZerocoinSpendSerialEntry(const CZerocoinSpend& spend) {
+    EraseZerocoinSerial(spend.GetSerial());
+    return CWalletDB(strWalletFile).WriteZerocoinSpendSerialEntry(spend);
+}
+
+std::list<CZerocoinMint> CWallet::ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus) const {
+    // Mints whose status gets rewritten or that get archived have to be reflected in the index
+    std::vector<std::pair<CBigNum, bool> > vSerialsChanged;
+    std::list<CZerocoinMint> listMints = CWalletDB(strWalletFile).ListMintedCoins(fUnusedOnly, fMaturedOnly, fUpdateStatus, &vSerialsChanged);
+    for (const auto& serial : vSerialsChanged) {
+        if (serial.second)
+            AddZerocoinSerial(serial.first);
+        else
+            EraseZerocoinSerial(serial.first);
+    }
+    return listMints;
+}
+
+unsigned int CWallet::GetZerocoinMintsVersion() const {
+    boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+    return nZerocoinMintsVersion;
+}
+
+bool CWallet::IsMyZerocoinSerial(const CBigNum& bnSerial) const {
+    boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+    return setZerocoinSerials.count(bnSerial) > 0;
+}
+
+void CWallet::QueueZerocoinSpendNotification(const CBigNum& bnSerial) {
+    {
+        boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+        vZerocoinSpendNotifications.push_back(bnSerial);
+    }
+    condZerocoinSpendNotifications.notify_one();
+}
+
+void CWallet::ThreadZerocoinSpendNotifications() {
+    RenameThread("idchain-zcnotify");
+
+    while (true) {
+        std::vector<CBigNum> vSerials;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_zerocoinSerials);
+            // wait() is an interruption point, so the thread stops with the rest of the thread group
+            while (vZerocoinSpendNotifications.empty())
+                condZerocoinSpendNotifications.wait(lock);
+            vSerials.swap(vZerocoinSpendNotifications);
+        }
+
+        for (const CBigNum& bnSerial : vSerials)
+            NotifyZerocoinChanged(this, bnSerial.GetHex(), "Used", CT_UPDATED);
+    }
+}
+
+void CWallet::UpdateZerocoinWitnesses() {
+    std::list<CZerocoinMint> listMints;
+    {
+        // the maturity filter walks mapBlockIndex and chainActive and may rewrite or archive mints
+        LOCK2(cs_main, cs_wallet);
+        listMints = ListMintedCoins(true, true, false);
+    }
+    int nUpdated = 0;
+    for (const CZerocoinMint& mint : listMints) {
+        boost::this_thread::interruption_point();
+
+        libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params(), mint.GetValue(), mint.GetDenomination());
+        CAccumulatorWitnessSnapshot snapshot;
+        if (!CWalletDB(strWalletFile).ReadZerocoinWitness(mint.GetValue(), snapshot))
+            snapshot.SetNull();
+
+        const int nHeightBefore = snapshot.nHeight;
+        const uint256 hashBefore = snapshot.hashBlock;
+        if (!UpdateAccumulatorWitnessSnapshot(pubcoin, snapshot))
+            continue;
+        if (snapshot.nHeight == nHeightBefore && snapshot.hashBlock == hashBefore)
+            continue;
+
+        // the mint may have been spent or archived while its witness was updated, both erase the
+        // witness under cs_wallet, so check and write under it too to never leave an orphan record
+        LOCK(cs_wallet);
+        CZerocoinMint mintCurrent;
+        CWalletDB walletdb(strWalletFile);
+        if (!walletdb.ReadZerocoinMint(mint.GetValue(), mintCurrent) || mintCurrent.IsUsed())
+            continue;
+
+        if (walletdb.WriteZerocoinWitness(mint.GetValue(), snapshot))
+            nUpdated++;
+    }
+
+    LogPrint("zero", "%s : updated %d of %d witnesses\n", __func__, nUpdated, listMints.size());
+}
+
+void CWallet::ThreadZerocoinWitnessUpdates() {
+    RenameThread("idchain-zcwitness");
+
+    int nLastCheckpointHeight = -1;
+    while (true) {
+        // MilliSleep() is an interruption point, so the thread stops with the rest of the thread group
+        MilliSleep(10000);
+
+        int nCheckpointHeight;
+        {
+            LOCK(cs_main);
+            if (IsInitialBlockDownload())
+                continue;
+            nCheckpointHeight = chainActive.Height() - (chainActive.Height() % 10);
+        }
+
+        if (nCheckpointHeight == nLastCheckpointHeight)
+            continue;
+
+        UpdateZerocoinWitnesses();
+        nLastCheckpointHeight = nCheckpointHeight;
+    }
+}
+
 string CWallet::MintZerocoin(CAmount nValue, CWalletTx& wtxNew, vector<CZerocoinMint>& vMints, const CCoinControl* coinControl) {
     // Check amount
     if (nValue <= 0)
@@ -4492,10 +4890,9 @@ string CWallet::MintZerocoin(CAmount nValue, CWalletTx& wtxNew, vector<CZerocoin
         return _("Error: The transaction was rejected! This might happen if some of the coins in your wallet were already spent, such as if you used a copy of wallet.dat and coins were spent in the copy but not marked as spent here.");
     } else {
         //update mints with full transaction hash and then database them
-        CWalletDB walletdb(pwalletMain->strWalletFile);
         for (CZerocoinMint mint : vMints) {
             mint.SetTxHash(wtxNew.GetHash());
-            walletdb.WriteZerocoinMint(mint);
+            WriteZerocoinMint(mint);
             pwalletMain->NotifyZerocoinChanged(pwalletMain, mint.GetValue().GetHex(), "Used", CT_UPDATED);
         }
     }
@@ -4533,7 +4930,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
         //reset all mints
         for (CZerocoinMint mint : vMintsSelected) {
             mint.SetUsed(false); // having error, so set to false, to be able to use again
-            walletdb.WriteZerocoinMint(mint);
+            WriteZerocoinMint(mint);
             pwalletMain->NotifyZerocoinChanged(pwalletMain, mint.GetValue().GetHex(), "New", CT_UPDATED);
         }
 
@@ -4549,7 +4946,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
 
         // erase new mints
         for (auto& mint : vNewMints) {
-            if (!walletdb.EraseZerocoinMint(mint)) {
+            if (!EraseZerocoinMint(mint)) {
                 receipt.SetStatus("Error: Unable to cannot delete zerocoin mint in wallet", ZIDC_ERASE_NEW_MINTS_FAILED);
             }
         }
@@ -4559,8 +4956,9 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
     }
 
     for (CZerocoinMint mint : vMintsSelected) {
+        LOCK(cs_wallet);
         mint.SetUsed(true);
-        if (!walletdb.WriteZerocoinMint(mint)) {
+        if (!WriteZerocoinMint(mint)) {
             receipt.SetStatus("Failed to write mint to db", nStatus);
             return false;
         }
@@ -4580,7 +4978,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
     // write new Mints to db
     for (CZerocoinMint mint : vNewMints) {
         mint.SetTxHash(wtxNew.GetHash());
-        walletdb.WriteZerocoinMint(mint);
+        WriteZerocoinMint(mint);
     }
 
     receipt.SetStatus("Spend Successful", ZIDC_SPEND_OKAY);  // When we reach this point spending zIDC was successful
@@ -34,6 +34,10 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_set.hpp>
+
 /**
  * Settings
  */
@@ -55,6 +59,10 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! -stakethreads default
+static const int DEFAULT_STAKE_THREADS = 1;
+//! Maximum number of threads searching the stake set for a kernel
+static const int MAX_STAKE_THREADS = 16;
 
 // Zerocoin denomination which creates exactly one of each denominations:
 // 1666 = 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
@@ -149,6 +157,13 @@ class CAddressBookData {
     StringMap destdata;
 };
 
+/** Hasher for zerocoin serials, which are uniformly distributed so their low 64 bits suffice */
+struct CZerocoinSerialHasher {
+    size_t operator()(const CBigNum& bnSerial) const {
+        return bnSerial.getuint256().GetLow64();
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -181,6 +196,53 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Wallet transactions that may still have an output for AvailableCoins() to return, so it does not
+     * have to walk all of mapWallet. A transaction leaves the set once each of its outputs is either not
+     * ours or spent by a confirmed wallet transaction. Only a reorganization or new scripts in the key
+     * store can change that again, and both make the set start over from all of mapWallet.
+     */
+    mutable std::set<uint256> setAvailableCoinsTxs;
+    //! Chain tip the set was last pruned at, NULL when it still holds every wallet transaction
+    mutable const CBlockIndex* pindexAvailableCoins;
+
+    //! Set when a rescan was aborted by a shutdown, SetBestChain() then never records more than it scanned
+    bool fRescanAborted;
+    CBlockLocator locatorRescanAborted;
+    bool IsSpentInChain(const uint256& hash, unsigned int n) const;
+    void ResetAvailableCoinsIndex();
+    void UpdateAvailableCoinsIndex() const;
+    //! The transactions in setAvailableCoinsTxs, which are the only ones that can add to a balance
+    std::vector<const CWalletTx*> GetAvailableCoinsTxs() const;
+
+    /**
+     * Serials of the wallet's unspent zerocoin mints, kept in line with the wallet database
+     * so that zerocoin spend validation does not have to scan it.
+     * Guarded by its own lock so it can be used from validation without taking cs_wallet.
+     */
+    mutable boost::mutex cs_zerocoinSerials;
+    mutable boost::unordered_set<CBigNum, CZerocoinSerialHasher> setZerocoinSerials;
+    //! Serials seen spent in validated transactions whose NotifyZerocoinChanged is still to be sent
+    std::vector<CBigNum> vZerocoinSpendNotifications;
+    boost::condition_variable condZerocoinSpendNotifications;
+    //! Bumped on every change to the wallet's zerocoin mints, guarded by cs_zerocoinSerials
+    mutable unsigned int nZerocoinMintsVersion;
+
+    /** A zerocoin balance along with the chain tip and version of the mints it was computed for */
+    struct CZerocoinBalanceCache {
+        bool fValid;
+        const CBlockIndex* pindex;
+        unsigned int nMintsVersion;
+        CAmount nAmount;
+
+        CZerocoinBalanceCache() : fValid(false), pindex(NULL), nMintsVersion(0), nAmount(0) {}
+    };
+    //! Mature, all unspent and unconfirmed zerocoin balance, saving a scan of the wallet database per query
+    mutable CZerocoinBalanceCache zerocoinBalanceMature, zerocoinBalanceAll, zerocoinBalanceUnconfirmed;
+    bool GetCachedZerocoinBalance(const CZerocoinBalanceCache& cache, CAmount& nAmount) const;
+    void SetCachedZerocoinBalance(CZerocoinBalanceCache& cache, unsigned int nMintsVersion, CAmount nAmount) const;
+    unsigned int GetZerocoinMintsVersion() const;
+
   public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -205,8 +267,32 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
     void ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored);
     void ZIDCBackupWallet();
 
+    /** Index of unspent zerocoin serials, see setZerocoinSerials */
+    void LoadZerocoinSerials();
+    void AddZerocoinSerial(const CBigNum& bnSerial) const;
+    void EraseZerocoinSerial(const CBigNum& bnSerial) const;
+    bool IsMyZerocoinSerial(const CBigNum& bnSerial) const;
+
+    /** Zerocoin mint records of the wallet database, these keep setZerocoinSerials in line with it */
+    bool WriteZerocoinMint(const CZerocoinMint& mint);
+    bool EraseZerocoinMint(const CZerocoinMint& mint);
+    bool ArchiveMintOrphan(const CZerocoinMint& mint);
+    bool UnarchiveZerocoin(const CZerocoinMint& mint);
+    bool WriteZerocoinSpendSerialEntry(const CZerocoinSpend& spend);
+    std::list<CZerocoinMint> ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus) const;
+
+    /** Queue a NotifyZerocoinChanged "Used" signal for one of our serials that was seen spent during validation */
+    void QueueZerocoinSpendNotification(const CBigNum& bnSerial);
+    /** Deliver queued zerocoin spend notifications, run as its own thread so validation never waits on the UI */
+    void ThreadZerocoinSpendNotifications();
+    /** Advance the stored witness snapshot of every unspent mint to the current chain */
+    void UpdateZerocoinWitnesses();
+    /** Run UpdateZerocoinWitnesses() whenever a new accumulator checkpoint is reached */
+    void ThreadZerocoinWitnessUpdates();
+
     /** Zerocin entry changed.
-    * @note called with lock cs_wallet held.
+    * @note may be called without cs_wallet held: spends seen during validation are
+    * delivered from ThreadZerocoinSpendNotifications. Handlers must not rely on the lock.
     */
     boost::signals2::signal<void(CWallet* wallet, const std::string& pubCoin, const std::string& isUsed, ChangeType status)> NotifyZerocoinChanged;
     /*
@@ -236,6 +322,11 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
     uint64_t nStakeSplitThreshold;
     int nStakeSetUpdateTime;
 
+    // Last stake search, guarded by cs_wallet
+    int nStakeSearchThreads;
+    int64_t nStakeSearchCoins;
+    int64_t nStakeSearchMicros;
+
     //MultiSend
     std::vector<std::pair<std::string, std::vector<std::pair<std::string, int>>>> vMultiSend;
     bool fMultiSendStake;
@@ -276,12 +367,18 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
+        pindexAvailableCoins = NULL;
+        fRescanAborted = false;
+        nZerocoinMintsVersion = 0;
 
         // Stake Settings
         nHashDrift = 45;
         nStakeSplitThreshold = 2000;
         nHashInterval = 22;
         nStakeSetUpdateTime = 300; // 5 minutes
+        nStakeSearchThreads = 0;
+        nStakeSearchCoins = 0;
+        nStakeSearchMicros = 0;
 
         //MultiSend
         vMultiSend.clear();
@@ -432,7 +529,7 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
-    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool* pfAborted = NULL);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;
@@ -468,6 +565,7 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
     int GenerateObfuscationOutputs(int nTotalValue, std::vector<CTxOut>& vout);
     bool CreateCollateralTransaction(CMutableTransaction& txCollateral, std::string& strReason);
     bool ConvertList(std::vector<CTxIn> vCoins, std::vector<int64_t>& vecAmounts);
+    int FindStakeKernel(const std::vector<std::pair<const CWalletTx*, unsigned int> >& vStakeCoins, unsigned int nBits, unsigned int& nTxNewTime);
     bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, unsigned int& nTxNewTime);
     bool MultiSend();
     bool isMSAddressEnabled(std::string address);
@@ -8,6 +8,7 @@
 
 #include "walletdb.h"
 
+#include "accumulators.h"
 #include "base58.h"
 #include "protocol.h"
 #include "serialize.h"
@@ -988,7 +989,12 @@ bool CWalletDB::WriteZerocoinMint(const CZerocoinMint& zerocoinMint) {
     uint256 hash = Hash(ss.begin(), ss.end());
 
     Erase(make_pair(string("zerocoin"), hash));
-    return Write(make_pair(string("zerocoin"), hash), zerocoinMint, true);
+    if (!Write(make_pair(string("zerocoin"), hash), zerocoinMint, true))
+        return false;
+
+    if (zerocoinMint.IsUsed())
+        Erase(make_pair(string("zcwitness"), hash));
+    return true;
 }
 
 bool CWalletDB::ReadZerocoinMint(const CBigNum &bnPubCoinValue, CZerocoinMint& zerocoinMint) {
@@ -1004,9 +1010,27 @@ bool CWalletDB::EraseZerocoinMint(const CZerocoinMint& zerocoinMint) {
     ss << zerocoinMint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());
 
+    Erase(make_pair(string("zcwitness"), hash));
     return Erase(make_pair(string("zerocoin"), hash));
 }
 
+bool CWalletDB::WriteZerocoinWitness(const CBigNum& bnPubcoin, const CAccumulatorWitnessSnapshot& snapshot) {
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubcoin;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    nWalletDBUpdated++;
+    return Write(make_pair(string("zcwitness"), hash), snapshot);
+}
+
+bool CWalletDB::ReadZerocoinWitness(const CBigNum& bnPubcoin, CAccumulatorWitnessSnapshot& snapshot) {
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubcoin;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    return Read(make_pair(string("zcwitness"), hash), snapshot);
+}
+
 bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint) {
     CDataStream ss(SER_GETHASH, 0);
     ss << zerocoinMint.GetValue();
@@ -1017,6 +1041,7 @@ bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint) {
         return false;
     }
 
+    Erase(make_pair(string("zcwitness"), hash));
     if (!Erase(make_pair(string("zerocoin"), hash))) {
         LogPrintf("%s : failed to erase orphaned zerocoin mint\n", __func__);
         return false;
@@ -1038,7 +1063,7 @@ bool CWalletDB::UnarchiveZerocoin(const CZerocoinMint& mint) {
     return WriteZerocoinMint(mint);
 }
 
-std::list<CZerocoinMint> CWalletDB::ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus) {
+std::list<CZerocoinMint> CWalletDB::ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus, std::vector<std::pair<CBigNum, bool> >* pvSerialsChanged) {
     std::list<CZerocoinMint> listPubCoin;
     Dbc* pcursor = GetCursor();
     if (!pcursor)
@@ -1140,12 +1165,16 @@ std::list<CZerocoinMint> CWalletDB::ListMintedCoins(bool fUnusedOnly, bool fMatu
     for (CZerocoinMint mint : vOverWrite) {
         if(!this->WriteZerocoinMint(mint))
             LogPrintf("%s failed to update mint from tx %s\n", __func__, mint.GetTxHash().GetHex());
+        else if (pvSerialsChanged)
+            pvSerialsChanged->push_back(make_pair(mint.GetSerialNumber(), !mint.IsUsed()));
     }
 
     // archive mints
     for (CZerocoinMint mint : vArchive) {
         if (!this->ArchiveMintOrphan(mint))
             LogPrintf("%s failed to archive mint from %s\n", __func__, mint.GetTxHash().GetHex());
+        else if (pvSerialsChanged)
+            pvSerialsChanged->push_back(make_pair(mint.GetSerialNumber(), false));
     }
 
     return listPubCoin;
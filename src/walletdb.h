@@ -23,6 +23,7 @@
 
 class CAccount;
 class CAccountingEntry;
+class CAccumulatorWitnessSnapshot;
 struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
@@ -146,7 +147,8 @@ class CWalletDB : public CDB {
     bool ReadZerocoinMint(const CBigNum &bnSerial, CZerocoinMint& zerocoinMint);
     bool ArchiveMintOrphan(const CZerocoinMint& zerocoinMint);
     bool UnarchiveZerocoin(const CZerocoinMint& mint);
-    std::list<CZerocoinMint> ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus);
+    /** Mints it rewrites or archives are added to pvSerialsChanged, with whether they are still unspent */
+    std::list<CZerocoinMint> ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus, std::vector<std::pair<CBigNum, bool> >* pvSerialsChanged = NULL);
     std::list<CZerocoinSpend> ListSpentCoins();
     std::list<CBigNum> ListMintedCoinsSerial();
     std::list<CBigNum> ListSpentCoinsSerial();
@@ -154,6 +156,8 @@ class CWalletDB : public CDB {
     bool WriteZerocoinSpendSerialEntry(const CZerocoinSpend& zerocoinSpend);
     bool EraseZerocoinSpendSerialEntry(const CBigNum& serialEntry);
     bool ReadZerocoinSpendSerialEntry(const CBigNum& bnSerial);
+    bool WriteZerocoinWitness(const CBigNum& bnPubcoin, const CAccumulatorWitnessSnapshot& snapshot);
+    bool ReadZerocoinWitness(const CBigNum& bnPubcoin, CAccumulatorWitnessSnapshot& snapshot);
 
   private:
     CWalletDB(const CWalletDB&);